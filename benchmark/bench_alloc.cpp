@@ -0,0 +1,66 @@
+/* Zupply benchmark: heap allocations per log call */
+#include "../src/zupply.hpp"
+#include <cstdlib>
+#include <new>
+
+using namespace zz;
+
+static std::atomic<std::size_t> gAllocCount(0);
+
+void* operator new(std::size_t size)
+{
+	++gAllocCount;
+	void *p = std::malloc(size ? size : 1);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) ZUPPLY_NOEXCEPT
+{
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t) ZUPPLY_NOEXCEPT
+{
+	std::free(p);
+}
+
+template <typename Func>
+void measure(const char *name, int iterations, Func func)
+{
+	// warm up, let thread local caches and sinks settle
+	for (int i = 0; i < 100; ++i) func(i);
+	std::size_t before = gAllocCount;
+	for (int i = 0; i < iterations; ++i) func(i);
+	std::size_t allocs = gAllocCount - before;
+	std::cout << name << ": " << static_cast<double>(allocs) / iterations << " allocations per call" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	const int kIterations = 100000;
+	std::ostream nullStream(nullptr);
+
+	auto logger = log::get_logger("bench_alloc");
+	logger->detach_all_sinks();
+	logger->set_level_mask(log::level_mask_from_string("info warn"));
+	logger->attach_sink(log::new_ostream_sink(nullStream, "null_stream"));
+
+	measure("format style", kIterations, [&](int i){ logger->info("Sequence {} of {}", i, kIterations); });
+	measure("stream style", kIterations, [&](int i){ logger->info() << "Sequence " << i << " of " << kIterations; });
+	measure("long message", kIterations, [&](int i){ logger->info("A long message that does not fit into small string buffer {}", i); });
+	measure("filtered level", kIterations, [&](int i){ logger->debug("Sequence {} of {}", i, kIterations); });
+
+	auto sink = log::new_ostream_sink(nullStream, "null_stream2");
+	logger->attach_sink(sink);
+	measure("two sinks", kIterations, [&](int i){ logger->info("Sequence {} of {}", i, kIterations); });
+	logger->detach_all_sinks();
+
+	auto async = log::new_async_sink(sink);
+	logger->attach_sink(async);
+	measure("async sink", kIterations, [&](int i){ logger->info("Sequence {} of {}", i, kIterations); });
+	async->flush();
+	logger->detach_all_sinks();
+
+	return 0;
+}
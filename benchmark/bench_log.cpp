@@ -0,0 +1,127 @@
+/* Zupply benchmark: logging throughput and per call latency, printed as csv */
+#include "../src/zupply.hpp"
+
+using namespace zz;
+
+struct BenchResult
+{
+	std::uint64_t			calls;
+	double					seconds;
+	log::LatencyHistogram	latency;
+};
+
+void run_case(log::LoggerPtr logger, bool enabled, int threads, int iterations, BenchResult &result)
+{
+	std::vector<std::unique_ptr<log::LatencyHistogram>> histograms;
+	for (int t = 0; t < threads; ++t) histograms.emplace_back(new log::LatencyHistogram());
+
+	std::atomic<int> ready(0);
+	std::atomic_bool go(false);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; ++t)
+	{
+		workers.push_back(std::thread([&, t]()
+		{
+			log::LatencyHistogram &hist = *histograms[t];
+			++ready;
+			while (!go) std::this_thread::yield();
+			for (int i = 0; i < iterations; ++i)
+			{
+				auto start = log::detail::steady_ns();
+				if (enabled) logger->info("Sequence {} of {}, value {}", i, iterations, 3.14);
+				else logger->debug("Sequence {} of {}, value {}", i, iterations, 3.14);
+				hist.record(log::detail::steady_ns() - start);
+			}
+		}));
+	}
+	while (ready < threads) std::this_thread::yield();
+	time::Timer timer;
+	go = true;
+	for (auto &w : workers) w.join();
+	result.seconds = timer.elapsed_ns() / 1e9;
+	result.calls = static_cast<std::uint64_t>(threads) * iterations;
+	for (auto &hist : histograms) result.latency.merge(*hist);
+}
+
+int main(int argc, char** argv)
+{
+	cfg::ArgParser argparser;
+	argparser.add_info("Measure logging throughput and per call latency of sinks, results are printed as csv");
+	argparser.add_opt_help('h', "help");
+
+	int maxThreads;
+	int iterations;
+	std::string output;
+	bool withStdout;
+	argparser.add_opt_value('t', "threads", maxThreads, static_cast<int>(std::thread::hardware_concurrency()),
+		"maximum number of threads, tested with 1, 2, 4... up to it", "N");
+	argparser.add_opt_value('n', "iterations", iterations, 100000, "log calls per thread", "N");
+	argparser.add_opt_value('o', "output", output, std::string(), "write results to file instead of stdout", "file");
+	argparser.add_opt_flag('s', "stdout", "also benchmark stdout sink, redirect stdout and use -o", &withStdout);
+	argparser.parse(argc, argv);
+
+	if (argparser.count_error() > 0)
+	{
+		std::cerr << argparser.get_error() << std::endl;
+		std::cerr << argparser.get_help() << std::endl;
+		return -1;
+	}
+	if (maxThreads < 1) maxThreads = 1;
+
+	std::vector<int> threadCounts;
+	for (int t = 1; t < maxThreads; t *= 2) threadCounts.push_back(t);
+	threadCounts.push_back(maxThreads);
+
+	const char *simpleFile = "bench_simple.log";
+	const char *rotateFile = "bench_rotate.log";
+	const char *ostreamFile = "bench_ostream.log";
+	std::ofstream ostreamOut(ostreamFile);
+
+	std::vector<std::pair<std::string, log::SinkPtr>> sinks;
+	sinks.push_back(std::make_pair("null", log::new_null_sink("bench_null")));
+	sinks.push_back(std::make_pair("ostream", log::new_ostream_sink(ostreamOut, "bench_ostream")));
+	sinks.push_back(std::make_pair("simple_file", log::new_simple_file_sink(simpleFile, true)));
+	sinks.push_back(std::make_pair("rotate_file", log::new_rotate_file_sink(rotateFile)));
+	if (withStdout) sinks.push_back(std::make_pair("stdout", log::new_stdout_sink()));
+
+	std::fstream outFile;
+	if (!output.empty())
+	{
+		os::fstream_open(outFile, output, std::ios::out | std::ios::trunc);
+		if (!outFile.is_open())
+		{
+			std::cerr << "Unable to open: " << output << std::endl;
+			return -1;
+		}
+	}
+	std::ostream &out = output.empty() ? std::cout : outFile;
+	out << "sink,level,threads,calls,seconds,calls_per_sec,p50_ns,p99_ns,p999_ns,max_ns" << std::endl;
+
+	for (auto &sink : sinks)
+	{
+		auto logger = std::make_shared<log::Logger>("bench_" + sink.first, log::level_mask_from_string("info"));
+		sink.second->set_level_mask(log::level_mask_from_string("info"));
+		logger->attach_sink(sink.second);
+		for (int enabled = 1; enabled >= 0; --enabled)
+		{
+			for (int threads : threadCounts)
+			{
+				BenchResult result;
+				run_case(logger, enabled != 0, threads, iterations, result);
+				sink.second->flush();
+				out << sink.first << "," << (enabled ? "enabled" : "filtered") << "," << threads << ","
+					<< result.calls << "," << result.seconds << "," << static_cast<std::uint64_t>(result.calls / result.seconds) << ","
+					<< result.latency.percentile(50) << "," << result.latency.percentile(99) << ","
+					<< result.latency.percentile(99.9) << "," << result.latency.max() << std::endl;
+			}
+		}
+		logger->detach_all_sinks();
+	}
+
+	sinks.clear();
+	ostreamOut.close();
+	os::remove_all(simpleFile);
+	os::remove_all(rotateFile);
+	os::remove_all(ostreamFile);
+	return 0;
+}
@@ -51,10 +51,24 @@ void config_examples()
 	defaultLogger->info("And debug message.");
 }
 
+void rate_limit_examples()
+{
+	auto defaultLogger = log::get_logger("default");
+	for (int i = 0; i < 1000; ++i)
+	{
+		// the macro keeps its own state for this call site
+		ZZ_LOG_EVERY_N(defaultLogger, info, 100, "Macro sampled message {}", i);
+		// without the macro, the call site state must be passed in explicitly
+		static log::LogSite site;
+		defaultLogger->info_every_n(site, 100, "Sampled message {}", i);
+	}
+}
+
 int main(int argc, char** argv)
 {
 	logger_examples();
 	config_examples();
+	rate_limit_examples();
 	return 0;
 }
 
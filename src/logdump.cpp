@@ -0,0 +1,89 @@
+/* Zupply tool: logdump, render binary or ring logs back to text */
+#include "zupply.hpp"
+using namespace zz;
+
+int main(int argc, char** argv)
+{
+	cfg::ArgParser argparser;
+	argparser.add_info("Decode binary logs written by binary file sink, or unwrap ring file sink logs into text");
+	argparser.add_opt_help('h', "help");
+
+	std::string format;
+	std::string datetimeFormat;
+	std::string input;
+	std::string output;
+	bool ring;
+	argparser.add_opt_flag('r', "ring", "input is a ring log file", &ring);
+	argparser.add_opt_value('f', "format", format, std::string(log::consts::kDefaultLoggerFormat), "message format", "FORMAT");
+	argparser.add_opt_value('d', "datetime", datetimeFormat, std::string(log::consts::kDefaultLoggerDatetimeFormat), "datetime format", "FORMAT");
+	argparser.add_opt_value(-1, "", input, std::string(), "binary log file", "file").require();
+	argparser.add_opt_value(-1, "", output, std::string(), "output text file, stdout if not specified", "file");
+	argparser.parse(argc, argv);
+
+	if (argparser.count_error() > 0)
+	{
+		std::cerr << argparser.get_error() << std::endl;
+		std::cerr << argparser.get_help() << std::endl;
+		return -1;
+	}
+	// formats may contain spaces, take the raw strings
+	if (argparser.count("format") > 0) format = fmt::trim(argparser["format"].str());
+	if (argparser.count("datetime") > 0) datetimeFormat = fmt::trim(argparser["datetime"].str());
+
+	if (ring)
+	{
+		try
+		{
+			std::string text = log::read_ring_log(input);
+			if (output.empty())
+			{
+				std::cout << text;
+			}
+			else
+			{
+				std::fstream out;
+				os::fstream_open(out, output, std::ios::out | std::ios::binary | std::ios::trunc);
+				out << text;
+			}
+		}
+		catch (std::exception &e)
+		{
+			std::cerr << e.what() << std::endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	std::ifstream in;
+	os::ifstream_open(in, input, std::ios::in | std::ios::binary);
+	if (!in.is_open())
+	{
+		std::cerr << "Unable to open: " << input << std::endl;
+		return -1;
+	}
+
+	try
+	{
+		if (output.empty())
+		{
+			log::decode_binary_log(in, std::cout, format, datetimeFormat);
+		}
+		else
+		{
+			std::fstream out;
+			os::fstream_open(out, output, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!out.is_open())
+			{
+				std::cerr << "Unable to open: " << output << std::endl;
+				return -1;
+			}
+			log::decode_binary_log(in, out, format, datetimeFormat);
+		}
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+	return 0;
+}
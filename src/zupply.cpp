@@ -75,6 +75,10 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <fcntl.h>
 #endif
 
 #include "zupply.hpp"
@@ -95,6 +99,7 @@
 #include <cstring>
 #include <deque>
 #include <cstdarg>
+#include <limits>
 #include <csignal>
 
 // UTF8CPP
@@ -7504,7 +7509,7 @@ namespace zz
 
 				unsigned int stbiw__crc32(unsigned char *buffer, int len)
 				{
-					unsigned int crc_table[256];
+					static unsigned int crc_table[256];
 					unsigned int crc = ~0u;
 					int i, j;
 					if (crc_table[1] == 0)
@@ -11173,6 +11178,79 @@ namespace zz
 			return size;
 		}
 
+		MemoryMappedFile::MemoryMappedFile(std::string filename, std::size_t size)
+			:size_(size), data_(nullptr), file_(-1), mapping_(nullptr)
+		{
+			filename_ = os::absolute_path(filename);
+			if (size_ < 1) throw ArgException("Memory mapped file size must be positive.");
+#if ZUPPLY_OS_WINDOWS
+			std::wstring wfilename = os::utf8_to_wstring(filename_);
+			HANDLE file = ::CreateFileW(wfilename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+				NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (file == INVALID_HANDLE_VALUE) throw RuntimeException("Failed to open file: " + filename_);
+			file_ = reinterpret_cast<std::intptr_t>(file);
+			std::uint64_t size64 = static_cast<std::uint64_t>(size_);
+			HANDLE mapping = ::CreateFileMappingW(file, NULL, PAGE_READWRITE,
+				static_cast<DWORD>(size64 >> 32), static_cast<DWORD>(size64 & 0xFFFFFFFF), NULL);
+			if (mapping == NULL)
+			{
+				close();
+				throw RuntimeException("Failed to create file mapping: " + filename_);
+			}
+			mapping_ = mapping;
+			data_ = static_cast<char*>(::MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size_));
+			if (data_ == nullptr)
+			{
+				close();
+				throw RuntimeException("Failed to map file: " + filename_);
+			}
+#elif ZUPPLY_OS_UNIX
+			int fd = ::open(filename_.c_str(), O_RDWR | O_CREAT, 0644);
+			if (fd < 0) throw RuntimeException("Failed to open file: " + filename_);
+			file_ = fd;
+			struct stat st;
+			if (::fstat(fd, &st) != 0 || (static_cast<std::size_t>(st.st_size) != size_ && ::ftruncate(fd, size_) != 0))
+			{
+				close();
+				throw RuntimeException("Failed to resize file: " + filename_);
+			}
+			void *addr = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (addr == MAP_FAILED)
+			{
+				close();
+				throw RuntimeException("Failed to map file: " + filename_);
+			}
+			data_ = static_cast<char*>(addr);
+#else
+			throw RuntimeException("Memory mapped file is not supported on this platform.");
+#endif
+		}
+
+		void MemoryMappedFile::flush()
+		{
+			if (!data_) return;
+#if ZUPPLY_OS_WINDOWS
+			::FlushViewOfFile(data_, 0);
+#elif ZUPPLY_OS_UNIX
+			::msync(data_, size_, MS_ASYNC);
+#endif
+		}
+
+		void MemoryMappedFile::close()
+		{
+#if ZUPPLY_OS_WINDOWS
+			if (data_) ::UnmapViewOfFile(data_);
+			if (mapping_) ::CloseHandle(static_cast<HANDLE>(mapping_));
+			if (file_ != -1) ::CloseHandle(reinterpret_cast<HANDLE>(file_));
+#elif ZUPPLY_OS_UNIX
+			if (data_) ::munmap(data_, size_);
+			if (file_ != -1) ::close(static_cast<int>(file_));
+#endif
+			data_ = nullptr;
+			mapping_ = nullptr;
+			file_ = -1;
+		}
+
 	} //namespace fs
 
 
@@ -11378,7 +11456,7 @@ namespace zz
 #endif
 		}
 
-		std::size_t thread_id()
+		std::size_t query_thread_id()
 		{
 #if ZUPPLY_OS_WINDOWS
 			// It exists because the std::this_thread::get_id() is much slower(espcially under VS 2013)
@@ -11400,6 +11478,56 @@ namespace zz
 
 		}
 
+		std::size_t thread_id()
+		{
+			// thread ids are never 0, use it as not queried yet
+			static thread_local std::size_t id = 0;
+			if (id == 0) id = query_thread_id();
+			return id;
+		}
+
+		const std::string*& thread_name_slot()
+		{
+			static const std::string empty;
+			static thread_local const std::string *name = &empty;
+			return name;
+		}
+
+		void set_thread_name(std::string name)
+		{
+			// names are interned and never released, log messages refer to them by address
+			static std::mutex mutex;
+			static std::map<std::string, std::unique_ptr<const std::string>> names;
+			const std::string *interned;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				auto &entry = names[name];
+				if (!entry) entry.reset(new std::string(name));
+				interned = entry.get();
+			}
+			thread_name_slot() = interned;
+#if __linux__
+			pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#endif
+		}
+
+		const std::string& thread_name()
+		{
+			return *thread_name_slot();
+		}
+
+		bool lower_thread_priority()
+		{
+#if ZUPPLY_OS_WINDOWS
+			return ::SetThreadPriority(::GetCurrentThread(), THREAD_PRIORITY_LOWEST) != 0;
+#elif __linux__
+			// linux threads have their own nice value
+			return ::setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19) == 0;
+#else
+			return false;
+#endif
+		}
+
 		int is_atty()
 		{
 #if ZUPPLY_OS_WINDOWS
@@ -12840,6 +12968,7 @@ namespace zz
 					{
 						o->val_ = o->val_.str() + " " + args_[0].str();
 						++o->count_;
+						++o->size_;
 						--n;
 						args_.erase(args_.begin());
 					}
@@ -13193,32 +13322,30 @@ namespace zz
 
 			LoggerPtr LoggerRegistry::ensure_get(std::string &name)
 			{
-				LoggerPtr ptr;
-				if (loggers_.get(name, ptr))
-				{
-					return ptr;
-				}
-
-				do
+				LoggerPtr ptr = get(name);
+				while (!ptr)
 				{
+					// lost the race to another creator, or it is dropped again
 					ptr = new_registry(name);
-				} while (ptr == nullptr);
-
+					if (!ptr) ptr = get(name);
+				}
 				return ptr;
 			}
 
 			LoggerPtr LoggerRegistry::get(std::string &name)
 			{
-				LoggerPtr ptr;
-				if (loggers_.get(name, ptr)) return ptr;
+				auto loggers = loggers_.get();
+				auto iter = loggers->find(name);
+				if (iter != loggers->end()) return iter->second;
 				return nullptr;
 			}
 
 			std::vector<LoggerPtr> LoggerRegistry::get_all()
 			{
 				std::vector<LoggerPtr> list;
-				auto loggers = loggers_.snapshot();
-				for (auto logger : loggers)
+				auto loggers = loggers_.get();
+				list.reserve(loggers->size());
+				for (auto &logger : *loggers)
 				{
 					list.push_back(logger.second);
 				}
@@ -13227,12 +13354,14 @@ namespace zz
 
 			void LoggerRegistry::drop(const std::string &name)
 			{
-				loggers_.erase(name);
+				loggers_.modify([&name](LoggerMap &loggers) { return loggers.erase(name) > 0; });
+				generation_.fetch_add(1, std::memory_order_acq_rel);
 			}
 
 			void LoggerRegistry::drop_all()
 			{
-				loggers_.clear();
+				loggers_.set(LoggerMap());
+				generation_.fetch_add(1, std::memory_order_acq_rel);
 			}
 
 			void LoggerRegistry::lock()
@@ -13271,154 +13400,1474 @@ namespace zz
 					}
 					if (psink) newLogger->attach_sink(psink);
 				}
-				if (loggers_.insert(name, newLogger))
+				bool inserted = loggers_.modify([&name, &newLogger](LoggerMap &loggers)
+				{
+					return loggers.insert(std::make_pair(name, newLogger)).second;
+				});
+				return inserted ? newLogger : nullptr;
+			}
+
+			bool gzip_file(std::string src, std::string dst)
+			{
+				std::ifstream in;
+				os::ifstream_open(in, src, std::ios::in | std::ios::binary);
+				if (!in.is_open()) return false;
+				std::vector<unsigned char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+				in.close();
+				if (data.size() > static_cast<std::size_t>(INT_MAX)) return false;
+
+				int len = 0;
+				int dataLen = static_cast<int>(data.size());
+				unsigned char *zlib = thirdparty::stbi::encode::stbi_zlib_compress(data.data(), dataLen, &len, 8);
+				if (!zlib) return false;
+				unsigned int crc = thirdparty::stbi::encode::stbiw__crc32(data.data(), dataLen);
+
+				std::fstream out;
+				os::fstream_open(out, dst, std::ios::out | std::ios::trunc | std::ios::binary);
+				if (out.is_open())
+				{
+					// gzip member: 10 byte header, raw deflate stream(zlib without 2 byte header and adler32), crc32, size
+					const unsigned char header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+					unsigned char trailer[8];
+					for (int i = 0; i < 4; ++i)
+					{
+						trailer[i] = static_cast<unsigned char>(crc >> (8 * i));
+						trailer[4 + i] = static_cast<unsigned char>(static_cast<unsigned int>(dataLen) >> (8 * i));
+					}
+					out.write(reinterpret_cast<const char*>(header), sizeof(header));
+					out.write(reinterpret_cast<const char*>(zlib + 2), len - 6);
+					out.write(reinterpret_cast<const char*>(trailer), sizeof(trailer));
+					out.close();
+				}
+				STBIW_FREE(zlib);
+				if (!out)
 				{
-					return newLogger;
+					os::remove_all(dst);
+					return false;
 				}
-				return nullptr;
+				return true;
 			}
 
-			RotateFileSink::RotateFileSink(const std::string filename, std::size_t maxSizeInByte, bool backup)
-				:maxSizeInByte_(maxSizeInByte), backup_(backup)
+			bool gunzip_file(std::string src, std::string &content)
 			{
-				if (backup_)
+				std::ifstream in;
+				os::ifstream_open(in, src, std::ios::in | std::ios::binary);
+				if (!in.is_open()) return false;
+				std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+				in.close();
+				if (data.size() < 18 || data.size() > static_cast<std::size_t>(INT_MAX)) return false;
+				const unsigned char *p = reinterpret_cast<const unsigned char*>(data.data());
+				// only the plain header written by gzip_file() is expected
+				if (p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || p[3] != 0) return false;
+
+				int len = 0;
+				char *raw = thirdparty::stbi::decode::stbi_zlib_decode_noheader_malloc(data.data() + 10, static_cast<int>(data.size()) - 18, &len);
+				if (!raw) return false;
+				content.assign(raw, len);
+				STBI_FREE(raw);
+
+				unsigned int crc = 0;
+				unsigned int size = 0;
+				for (int i = 0; i < 4; ++i)
 				{
-					back_up(filename);
+					crc |= static_cast<unsigned int>(p[data.size() - 8 + i]) << (8 * i);
+					size |= static_cast<unsigned int>(p[data.size() - 4 + i]) << (8 * i);
 				}
-				fileEditor_.open(filename, true);
-				currentSize_ = 0;
+				unsigned char *bytes = reinterpret_cast<unsigned char*>(&content[0]);
+				return size == static_cast<unsigned int>(len)
+					&& crc == thirdparty::stbi::encode::stbiw__crc32(bytes, len);
 			}
 
-			void RotateFileSink::back_up(std::string oldFile)
+			BackgroundWorker::~BackgroundWorker()
 			{
-				std::string backupName = os::path_append_basename(oldFile,
-					time::DateTime::local_time().to_string("_%y-%m-%d_%H-%M-%S-%frac"));
-				os::rename(oldFile, backupName);
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					stop_ = true;
+				}
+				cv_.notify_all();
+				if (worker_.joinable()) worker_.join();
 			}
 
-			void RotateFileSink::rotate()
+			void BackgroundWorker::post(std::function<void()> task)
 			{
-				std::lock_guard<std::mutex> lock(mutex_);
-				// check again in case other thread
-				// just waited for this operation
-				if (currentSize_ > maxSizeInByte_)
 				{
-					if (backup_)
+					std::lock_guard<std::mutex> lock(mutex_);
+					tasks_.push_back(std::move(task));
+					if (!worker_.joinable()) worker_ = std::thread(&BackgroundWorker::run, this);
+				}
+				cv_.notify_all();
+			}
+
+			bool BackgroundWorker::try_post(std::function<void()> task)
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					if (maxTasks_ > 0 && tasks_.size() >= maxTasks_) return false;
+					tasks_.push_back(std::move(task));
+					if (!worker_.joinable()) worker_ = std::thread(&BackgroundWorker::run, this);
+				}
+				cv_.notify_all();
+				return true;
+			}
+
+			void BackgroundWorker::wait_idle()
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				cv_.wait(lock, [this]() { return tasks_.empty() && !busy_; });
+			}
+
+			void BackgroundWorker::run()
+			{
+				if (lowPriority_) os::lower_thread_priority();
+				std::unique_lock<std::mutex> lock(mutex_);
+				for (;;)
+				{
+					cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+					// finish pending tasks before stop
+					if (tasks_.empty()) break;
+					auto task = std::move(tasks_.front());
+					tasks_.pop_front();
+					busy_ = true;
+					lock.unlock();
+					try
 					{
-						fileEditor_.close();
-						back_up(fileEditor_.filename());
-						fileEditor_.open(true);
+						task();
 					}
-					else
+					catch (...)
 					{
-						fileEditor_.reopen(true);
+						// worker must survive failed tasks
 					}
-					currentSize_ = 0;
+					lock.lock();
+					busy_ = false;
+					cv_.notify_all();
 				}
 			}
 
-			void sink_list_revise(std::vector<std::string> &list, std::map<std::string, std::string> &map)
+			RotateFileSink::RotateFileSink(const std::string filename, std::size_t maxSizeInByte, bool backup, std::size_t bufferSize,
+				RotateInterval interval, std::size_t maxBackups, bool compress)
+				:batch_(bufferSize), maxSizeInByte_(maxSizeInByte), backup_(backup), interval_(interval), maxBackups_(maxBackups),
+				compress_(compress), compressor_(consts::kRotateCompressQueueSize, true)
 			{
-				for (auto m : map)
+				filename_ = os::absolute_path(filename);
+				nextFilename_ = filename_ + consts::kRotateNextFileSuffix;
+				if (backup_)
 				{
-					for (auto l = list.begin(); l != list.end(); ++l)
+					scan_backups();
+					back_up(filename_);
+				}
+				file_.reset(new fs::FileEditor(filename_, true));
+				currentSize_ = 0;
+				nextRotateTime_ = next_rotate_time();
+#if ZUPPLY_OS_UNIX
+				open_next();
+#endif
+			}
+
+			RotateFileSink::~RotateFileSink()
+			{
+				flush();
+				worker_.wait_idle();
+				std::lock_guard<std::mutex> lock(nextMutex_);
+				if (next_)
+				{
+					next_->close();
+					next_.reset();
+					os::remove_all(nextFilename_);
+				}
+			}
+
+			std::chrono::system_clock::time_point RotateFileSink::next_rotate_time() const
+			{
+				if (interval_ == RotateInterval::none) return std::chrono::system_clock::time_point::max();
+				std::tm tm = os::localtime(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
+				tm.tm_sec = 0;
+				tm.tm_min = 0;
+				if (interval_ == RotateInterval::hourly)
+				{
+					tm.tm_hour += 1;
+				}
+				else
+				{
+					tm.tm_hour = 0;
+					tm.tm_mday += 1;
+				}
+				tm.tm_isdst = -1;
+				return std::chrono::system_clock::from_time_t(std::mktime(&tm));
+			}
+
+			void RotateFileSink::back_up(std::string oldFile)
+			{
+				std::string backupName = os::path_append_basename(oldFile,
+					time::DateTime::local_time().to_string(consts::kRotateBackupSuffix));
+				if (!os::rename(oldFile, backupName)) return;
+				if (!compress_)
+				{
+					add_backup(backupName);
+					return;
+				}
+				// pruning runs on the compressor thread after compression, so no file is removed while being compressed
+				bool posted = compressor_.try_post([this, backupName]()
+				{
+					if (gzip_file(backupName, backupName + consts::kRotateCompressSuffix)) os::remove_all(backupName);
+					add_backup(backupName);
+				});
+				// if compressor falls behind, backup is simply kept uncompressed
+				if (!posted) compressor_.post([this, backupName]() { add_backup(backupName); });
+			}
+
+			void RotateFileSink::add_backup(const std::string &backupName)
+			{
+				backups_.push_back(backupName);
+				prune_backups();
+			}
+
+			void RotateFileSink::scan_backups()
+			{
+				// backups from previous runs, names sort in time order
+				std::string prefix = os::path_append_basename(filename_, "_");
+				std::string ext = os::path_split_extension(filename_);
+				std::string suffix = ext.empty() ? std::string() : "." + ext;
+				prefix = prefix.substr(0, prefix.size() - suffix.size());
+				std::vector<std::string> found;
+				std::string gzSuffix = consts::kRotateCompressSuffix;
+				for (auto path : os::list_directory(os::path_split_directory(filename_)))
+				{
+					// compressed backups are tracked by their uncompressed name
+					if (fmt::ends_with(path, gzSuffix)) path.resize(path.size() - gzSuffix.size());
+					if (path.size() == prefix.size() + consts::kRotateBackupSuffixLength + suffix.size()
+						&& fmt::starts_with(path, prefix) && fmt::ends_with(path, suffix))
 					{
-						if (m.first == *l)
-						{
-							l = list.erase(l);
-							l = list.insert(l, m.second);
-						}
+						found.push_back(path);
 					}
 				}
+				std::sort(found.begin(), found.end());
+				found.erase(std::unique(found.begin(), found.end()), found.end());
+				backups_.assign(found.begin(), found.end());
 			}
 
-			void config_loggers_from_section(cfg::CfgLevel::section_map_t &section, std::map<std::string, std::string> &map)
+			void RotateFileSink::prune_backups()
 			{
-				for (auto loggerSec : section)
+				if (maxBackups_ < 1) return;
+				while (backups_.size() > maxBackups_)
 				{
-					for (auto value : loggerSec.second.values)
+					os::remove_all(backups_.front());
+					os::remove_all(backups_.front() + consts::kRotateCompressSuffix);
+					backups_.pop_front();
+				}
+			}
+
+			void RotateFileSink::open_next()
+			{
+				std::unique_ptr<fs::FileEditor> next(new fs::FileEditor(nextFilename_, true));
+				std::lock_guard<std::mutex> lock(nextMutex_);
+				next_ = std::move(next);
+			}
+
+			void RotateFileSink::rotate()
+			{
+				// already locked by Sink::log
+				batch_.drain(*file_);
+				nextRotateTime_ = next_rotate_time();
+#if ZUPPLY_OS_UNIX
+				std::unique_ptr<fs::FileEditor> next;
+				{
+					std::lock_guard<std::mutex> lock(nextMutex_);
+					next = std::move(next_);
+				}
+				if (!next)
+				{
+					// previous rotation is not finished yet
+					worker_.wait_idle();
+					std::lock_guard<std::mutex> lock(nextMutex_);
+					next = std::move(next_);
+				}
+				if (next)
+				{
+					// swap to pre-opened file, which is renamed to filename_ in background
+					std::shared_ptr<fs::FileEditor> old(file_.release());
+					file_ = std::move(next);
+					worker_.post([this, old]()
 					{
-						LoggerPtr logger = nullptr;
-						if (consts::kConfigLevelsSpecifier == value.first)
-						{
-							int mask = level_mask_from_string(value.second.str());
-							if (!logger) logger = get_logger(loggerSec.first, true);
-							logger->set_level_mask(mask);
-						}
-						else if (consts::kConfigSinkListSpecifier == value.first)
-						{
-							auto list = fmt::split_whitespace(value.second.str());
-							if (list.empty()) continue;
-							sink_list_revise(list, map);
-							if (!logger) logger = get_logger(loggerSec.first, true);
-							logger->detach_all_sinks();
-							logger->attach_sink_list(list);
-						}
-						else
-						{
-							zupply_internal_warn("Unrecognized configuration key: " + value.first);
-						}
-					}
+						old->close();
+						finish_rotation();
+					});
+					return;
 				}
+#endif
+				// synchronous rotation, open files can not be renamed on windows
+				file_->close();
+				if (backup_) back_up(filename_);
+				file_->open(filename_, true);
 			}
 
-			LoggerPtr get_hidden_logger()
+			void RotateFileSink::finish_rotation()
 			{
-				auto hlogger = get_logger("hidden", false);
-				if (!hlogger)
+				// runs in background worker
+				if (backup_) back_up(filename_);
+				os::rename(nextFilename_, filename_);
+				open_next();
+			}
+
+			RingFileSink::RingFileSink(const std::string filename, std::size_t capacity)
+				:mmf_(filename, consts::kRingLogHeaderSize + capacity), capacity_(capacity)
+			{
+				header_ = reinterpret_cast<RingLogHeader*>(mmf_.data());
+				ring_ = mmf_.data() + consts::kRingLogHeaderSize;
+				// continue existing ring if compatible, otherwise start over
+				if (std::strncmp(header_->magic_, consts::kRingLogMagic, sizeof(header_->magic_)) != 0
+					|| header_->capacity_ != capacity_)
 				{
-					hlogger = get_logger("hidden", true);
-					hlogger->set_level_mask(0);
+					std::memset(header_, 0, consts::kRingLogHeaderSize);
+					std::strncpy(header_->magic_, consts::kRingLogMagic, sizeof(header_->magic_));
+					header_->capacity_ = capacity_;
+					header_->writePos_ = 0;
 				}
-				return hlogger;
 			}
 
-			std::map<std::string, std::string> config_sinks_from_section(cfg::CfgLevel::section_map_t &section)
+			void RingFileSink::sink_it(const std::string &finalMsg, LogLevels)
 			{
-				std::map<std::string, std::string> sinkMap;
-				for (auto sinkSec : section)
+				// already locked by Sink::log
+				const char *src = finalMsg.data();
+				std::size_t size = finalMsg.size();
+				std::uint64_t writePos = header_->writePos_;
+				if (size > capacity_)
 				{
-					std::string type;
-					std::string filename;
-					std::string fmt;
-					std::string levelStr;
-					SinkPtr sink = nullptr;
+					// only the tail fits
+					writePos += size - capacity_;
+					src += size - capacity_;
+					size = capacity_;
+				}
+				std::size_t offset = static_cast<std::size_t>(writePos % capacity_);
+				std::size_t first = (std::min)(size, capacity_ - offset);
+				std::memcpy(ring_ + offset, src, first);
+				if (first < size) std::memcpy(ring_, src + first, size - first);
+				// publish data before position
+				std::atomic_signal_fence(std::memory_order_release);
+				header_->writePos_ = writePos + size;
+			}
 
-					for (auto value : sinkSec.second.values)
+			MemorySink::MemorySink(const std::string name, std::size_t capacity, std::size_t lineSize)
+				:name_(name), lineSize_(lineSize)
+			{
+				capacity_ = 1;
+				while (capacity_ < capacity) capacity_ <<= 1;
+				slots_.reset(new Slot[capacity_]);
+				data_.reset(new char[capacity_ * lineSize_]);
+				for (std::size_t i = 0; i < capacity_; ++i)
+				{
+					slots_[i].seq_ = 0;
+					slots_[i].ticket_ = (std::numeric_limits<std::uint64_t>::max)();
+					slots_[i].size_ = 0;
+				}
+				head_ = 0;
+			}
+
+			void MemorySink::log_with_format(const LogMessage& msg, const std::shared_ptr<const CompiledFormat> &format)
+			{
+				if (!level_should_log(level_mask(), msg.level_))
+				{
+					stats_.filtered_.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				RenderedLine line(msg, format);
+				bool timed = LogConfig::instance().latency_stats();
+				std::uint64_t start = timed ? steady_ns() : 0;
+				std::uint64_t ticket = head_.fetch_add(1, std::memory_order_relaxed);
+				std::size_t index = static_cast<std::size_t>(ticket & (capacity_ - 1));
+				Slot &slot = slots_[index];
+				std::uint64_t seq = slot.seq_.load(std::memory_order_relaxed);
+				if ((seq & 1) || !slot.seq_.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire))
+				{
+					stats_.dropped_.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				std::size_t size = (std::min)(line.str().size(), lineSize_);
+				std::memcpy(data_.get() + index * lineSize_, line.str().data(), size);
+				slot.size_.store(size, std::memory_order_relaxed);
+				slot.ticket_.store(ticket, std::memory_order_relaxed);
+				slot.seq_.store(seq + 2, std::memory_order_release);
+				if (timed) stats_.latency_.record(steady_ns() - start);
+				stats_.accepted_.fetch_add(1, std::memory_order_relaxed);
+				stats_.bytes_.fetch_add(size, std::memory_order_relaxed);
+			}
+
+			std::vector<std::string> MemorySink::lines() const
+			{
+				std::vector<std::string> result;
+				std::uint64_t head = head_.load(std::memory_order_acquire);
+				std::uint64_t begin = head > capacity_ ? head - capacity_ : 0;
+				result.reserve(static_cast<std::size_t>(head - begin));
+				for (std::uint64_t ticket = begin; ticket < head; ++ticket)
+				{
+					std::size_t index = static_cast<std::size_t>(ticket & (capacity_ - 1));
+					const Slot &slot = slots_[index];
+					std::uint64_t seq = slot.seq_.load(std::memory_order_acquire);
+					// being written, or already overwritten by a newer line
+					if ((seq & 1) || slot.ticket_.load(std::memory_order_relaxed) != ticket) continue;
+					std::size_t size = (std::min)(slot.size_.load(std::memory_order_relaxed), lineSize_);
+					std::string line(data_.get() + index * lineSize_, size);
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (slot.seq_.load(std::memory_order_relaxed) != seq) continue;
+					result.push_back(std::move(line));
+				}
+				return result;
+			}
+
+			SinkFlusher& SinkFlusher::instance()
+			{
+				// leaked on purpose, see class comment
+				static SinkFlusher *flusher = new SinkFlusher();
+				return *flusher;
+			}
+
+			void SinkFlusher::stop()
+			{
+				std::lock_guard<std::mutex> control(controlMutex_);
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					stop_ = true;
+				}
+				cv_.notify_all();
+				if (worker_.joinable()) worker_.join();
+				std::lock_guard<std::mutex> lock(mutex_);
+				worker_ = std::thread();
+				stop_ = false;
+			}
+
+			void SinkFlusher::add(SinkPtr sink, int interval)
+			{
+				std::lock_guard<std::mutex> control(controlMutex_);
+				std::lock_guard<std::mutex> lock(mutex_);
+				Entry entry;
+				entry.sink_ = sink;
+				entry.interval_ = std::chrono::milliseconds(interval);
+				entry.next_ = std::chrono::steady_clock::now() + entry.interval_;
+				entries_.push_back(entry);
+				if (!worker_.joinable()) worker_ = std::thread(&SinkFlusher::run, this);
+				cv_.notify_all();
+			}
+
+			void SinkFlusher::run()
+			{
+				std::vector<SinkPtr> due;
+				std::unique_lock<std::mutex> lock(mutex_);
+				while (!stop_)
+				{
+					auto now = std::chrono::steady_clock::now();
+					auto wakeup = now + std::chrono::hours(1);
+					for (auto iter = entries_.begin(); iter != entries_.end();)
 					{
-						// entries
-						if (consts::kConfigSinkTypeSpecifier == value.first)
-						{
-							type = value.second.str();
-						}
-						else if (consts::kConfigSinkFilenameSpecifier == value.first)
+						auto sink = iter->sink_.lock();
+						if (!sink)
 						{
-							filename = value.second.str();
+							iter = entries_.erase(iter);
+							continue;
 						}
-						else if (consts::kConfigFormatSpecifier == value.first)
+						if (iter->next_ <= now)
 						{
-							fmt = value.second.str();
+							due.push_back(sink);
+							iter->next_ = now + iter->interval_;
 						}
-						else if (consts::kConfigLevelsSpecifier == value.first)
+						wakeup = (std::min)(wakeup, iter->next_);
+						++iter;
+					}
+
+					// flush without holding the lock, sinks may be added meanwhile
+					lock.unlock();
+					for (auto &sink : due)
+					{
+						try
 						{
-							levelStr = value.second.str();
+							sink->flush();
 						}
-						else
+						catch (...)
 						{
-							zupply_internal_warn("Unrecognized config key entry: " + value.first);
+							// keep flushing the other sinks
 						}
 					}
+					due.clear();
+					lock.lock();
+					if (!stop_) cv_.wait_until(lock, wakeup);
+				}
+			}
 
-					// sink
-					if (type.empty()) throw RuntimeException("No suitable type specified for sink: " + sinkSec.first);
-					if (type == consts::kStdoutSinkName)
-					{
-						sink = new_stdout_sink();
-					}
-					else if (type == consts::kStderrSinkName)
+			CompiledFormat compile_format(const std::string &format)
+			{
+				static const std::vector<std::pair<std::string, FormatToken::Type>> specifiers{
+					{ consts::kSinkDatetimeSpecifier, FormatToken::Type::datetime },
+					{ consts::kSinkLoggerNameSpecifier, FormatToken::Type::logger },
+					{ consts::kSinkThreadSpecifier, FormatToken::Type::thread },
+					{ consts::kSinkLevelSpecifier, FormatToken::Type::level },
+					{ consts::kSinkLevelShortSpecifier, FormatToken::Type::level_short },
+					{ consts::kSinkMessageSpecifier, FormatToken::Type::message },
+					{ consts::kSinkFieldsSpecifier, FormatToken::Type::fields },
+					{ consts::kSinkJsonSpecifier, FormatToken::Type::json } };
+
+				CompiledFormat tokens;
+				std::string literal;
+				std::size_t pos = 0;
+				while (pos < format.size())
+				{
+					bool matched = false;
+					if (format[pos] == '%')
+					{
+						// '%' before specifier is escape char, e.g. "%%msg" -> "%msg"
+						bool escaped = (pos + 1 < format.size() && format[pos + 1] == '%');
+						std::size_t start = escaped ? pos + 1 : pos;
+						for (auto &spec : specifiers)
+						{
+							if (format.compare(start, spec.first.length(), spec.first) != 0) continue;
+							if (escaped)
+							{
+								literal += spec.first;
+							}
+							else
+							{
+								if (!literal.empty()) tokens.push_back({ FormatToken::Type::literal, literal });
+								literal.clear();
+								tokens.push_back({ spec.second, std::string() });
+							}
+							pos = start + spec.first.length();
+							matched = true;
+							break;
+						}
+					}
+					if (!matched)
+					{
+						literal += format[pos];
+						++pos;
+					}
+				}
+				if (!literal.empty()) tokens.push_back({ FormatToken::Type::literal, literal });
+				return tokens;
+			}
+
+			std::shared_ptr<const CompiledFormat> get_compiled_format(const std::string &format)
+			{
+				static std::mutex mutex;
+				static std::map<std::string, std::weak_ptr<const CompiledFormat>> formats;
+				std::lock_guard<std::mutex> lock(mutex);
+				auto iter = formats.find(format);
+				if (iter != formats.end())
+				{
+					auto compiled = iter->second.lock();
+					if (compiled) return compiled;
+				}
+				// drop formats no sink uses anymore, so the map stays as small as the live formats
+				for (auto it = formats.begin(); it != formats.end();)
+				{
+					if (it->second.expired()) it = formats.erase(it);
+					else ++it;
+				}
+				auto compiled = std::make_shared<const CompiledFormat>(compile_format(format));
+				formats[format] = compiled;
+				return compiled;
+			}
+
+			void render_datetime(const std::string &datetimeFormat, std::chrono::system_clock::time_point timeStamp, std::string &out)
+			{
+				// strftime results of the parts split by fraction specifiers,
+				// valid until second or datetime format changes
+				struct DatetimeCache
+				{
+					std::time_t					second = -1;
+					std::string					format;
+					std::vector<std::string>	parts;
+				};
+				static thread_local DatetimeCache cache;
+
+				std::time_t second = std::chrono::system_clock::to_time_t(timeStamp);
+				if (second != cache.second || datetimeFormat != cache.format)
+				{
+					cache.second = second;
+					cache.format = datetimeFormat;
+					cache.parts.clear();
+					std::tm calendar = os::localtime(second);
+					std::string fracSpecifier(time::consts::kDateFractionSpecifier);
+					std::string part;
+					std::size_t pos = 0;
+					while (pos < datetimeFormat.size())
+					{
+						if (datetimeFormat.compare(pos, fracSpecifier.length(), fracSpecifier) == 0)
+						{
+							if (pos > 0 && datetimeFormat[pos - 1] == '%')
+							{
+								// escaped, same as time::DateTime::to_string()
+								part.back() = '%';
+								part += fracSpecifier.substr(1);
+							}
+							else
+							{
+								cache.parts.push_back(part);
+								part.clear();
+							}
+							pos += fracSpecifier.length();
+							continue;
+						}
+						part += datetimeFormat[pos];
+						++pos;
+					}
+					cache.parts.push_back(part);
+
+					for (auto &p : cache.parts)
+					{
+						if (p.empty()) continue;
+						std::vector<char> mbuf(p.length() + 100);
+						std::size_t size = strftime(mbuf.data(), mbuf.size(), p.c_str(), &calendar);
+						while (size == 0 && mbuf.size() <= time::consts::kMaxDateTimeLength)
+						{
+							mbuf.resize(mbuf.size() * 2);
+							size = strftime(mbuf.data(), mbuf.size(), p.c_str(), &calendar);
+						}
+						p.assign(mbuf.data(), size);
+					}
+				}
+
+				int fraction = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+					timeStamp.time_since_epoch()).count() % math::Pow<10, time::consts::kDateFractionWidth>::result);
+				char fracStr[8];
+				std::snprintf(fracStr, sizeof(fracStr), "%0*d", static_cast<int>(time::consts::kDateFractionWidth), fraction);
+				for (std::size_t i = 0; i < cache.parts.size(); ++i)
+				{
+					if (i > 0) out += fracStr;
+					out += cache.parts[i];
+				}
+			}
+
+			ThreadBuffers& thread_buffers()
+			{
+				static thread_local ThreadBuffers buffers;
+				return buffers;
+			}
+
+			RenderCache& render_cache()
+			{
+				static thread_local RenderCache cache;
+				return cache;
+			}
+
+			template <typename T>
+			void append_unsigned(std::string &out, T value)
+			{
+				char buf[32];
+				char *end = buf + sizeof(buf);
+				char *p = end;
+				do
+				{
+					*--p = static_cast<char>('0' + value % 10);
+					value /= 10;
+				} while (value);
+				out.append(p, end);
+			}
+
+			template <typename T>
+			void append_signed(std::string &out, T value)
+			{
+				typedef typename std::make_unsigned<T>::type U;
+				if (value < 0)
+				{
+					out += '-';
+					append_unsigned(out, static_cast<U>(U(0) - static_cast<U>(value)));
+				}
+				else
+				{
+					append_unsigned(out, static_cast<U>(value));
+				}
+			}
+
+			void append_float(std::string &out, long double value)
+			{
+				// same as default std::ostream precision
+				char buf[64];
+				int n = std::snprintf(buf, sizeof(buf), "%Lg", value);
+				if (n > 0) out.append(buf, std::min(static_cast<std::size_t>(n), sizeof(buf) - 1));
+			}
+
+			void append_value(std::string &out, const std::string &value) { out += value; }
+			void append_value(std::string &out, const char *value) { if (value) out += value; }
+			void append_value(std::string &out, char value) { out += value; }
+			void append_value(std::string &out, bool value) { out += value ? '1' : '0'; }
+			void append_value(std::string &out, short value) { append_signed(out, value); }
+			void append_value(std::string &out, unsigned short value) { append_unsigned(out, value); }
+			void append_value(std::string &out, int value) { append_signed(out, value); }
+			void append_value(std::string &out, unsigned int value) { append_unsigned(out, value); }
+			void append_value(std::string &out, long value) { append_signed(out, value); }
+			void append_value(std::string &out, unsigned long value) { append_unsigned(out, value); }
+			void append_value(std::string &out, long long value) { append_signed(out, value); }
+			void append_value(std::string &out, unsigned long long value) { append_unsigned(out, value); }
+			void append_value(std::string &out, float value) { append_float(out, value); }
+			void append_value(std::string &out, double value) { append_float(out, value); }
+			void append_value(std::string &out, long double value) { append_float(out, value); }
+
+			bool append_until_placeholder(std::string &out, const char *fmt, std::size_t &pos)
+			{
+				const char *start = fmt + pos;
+				const char *p = start;
+				while (*p)
+				{
+					if (p[0] == '%' && p[1] == '{' && p[2] == '}')
+					{
+						// escaped placeholder
+						out.append(start, p);
+						out += "{}";
+						p += 3;
+						start = p;
+					}
+					else if (p[0] == '{' && p[1] == '}')
+					{
+						out.append(start, p);
+						pos = static_cast<std::size_t>(p + 2 - fmt);
+						return true;
+					}
+					else
+					{
+						++p;
+					}
+				}
+				pos = static_cast<std::size_t>(start - fmt);
+				return false;
+			}
+
+			struct BinaryFormatRegistry
+			{
+				std::mutex		mutex_;
+				std::unordered_map<std::string, std::uint32_t>	ids_;
+				std::vector<std::unique_ptr<std::string>>		formats_;	//!< formats_[id - 1], address never changes
+			};
+
+			BinaryFormatRegistry& binary_format_registry()
+			{
+				static BinaryFormatRegistry registry;
+				return registry;
+			}
+
+			std::uint32_t register_binary_format(const char *fmt)
+			{
+				struct CacheEntry
+				{
+					const char			*ptr;
+					const std::string	*str;
+					std::uint32_t		id;
+				};
+				static thread_local CacheEntry cache[64];
+
+				// verify content as well, address may be reused by a different string
+				CacheEntry &entry = cache[(reinterpret_cast<std::uintptr_t>(fmt) >> 3) % 64];
+				if (entry.ptr == fmt && std::strcmp(fmt, entry.str->c_str()) == 0) return entry.id;
+
+				auto &registry = binary_format_registry();
+				std::lock_guard<std::mutex> lock(registry.mutex_);
+				std::string key(fmt);
+				auto iter = registry.ids_.find(key);
+				std::uint32_t id;
+				if (iter == registry.ids_.end())
+				{
+					registry.formats_.emplace_back(new std::string(key));
+					id = static_cast<std::uint32_t>(registry.formats_.size());
+					registry.ids_[key] = id;
+				}
+				else
+				{
+					id = iter->second;
+				}
+				entry.ptr = fmt;
+				entry.str = registry.formats_[id - 1].get();
+				entry.id = id;
+				return id;
+			}
+
+			std::string binary_format(std::uint32_t id)
+			{
+				auto &registry = binary_format_registry();
+				std::lock_guard<std::mutex> lock(registry.mutex_);
+				if (id == 0 || id > registry.formats_.size())
+				{
+					throw RuntimeException("Binary format id: " + std::to_string(id) + " not registered.");
+				}
+				return *registry.formats_[id - 1];
+			}
+
+			template <typename T>
+			void append_raw(std::string &out, T value)
+			{
+				out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+			}
+
+			template <typename T>
+			bool read_raw(const char *&data, const char *end, T &value)
+			{
+				if (static_cast<std::size_t>(end - data) < sizeof(T)) return false;
+				std::memcpy(&value, data, sizeof(T));
+				data += sizeof(T);
+				return true;
+			}
+
+			template <typename T>
+			bool read_raw(std::istream &in, T &value)
+			{
+				return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+			}
+
+			bool read_string(std::istream &in, std::string &str)
+			{
+				std::uint32_t size;
+				if (!read_raw(in, size)) return false;
+				str.resize(size);
+				return size == 0 || static_cast<bool>(in.read(&str[0], size));
+			}
+
+			void append_string_raw(std::string &out, const char *str, std::size_t size)
+			{
+				append_raw(out, static_cast<std::uint32_t>(size));
+				out.append(str, size);
+			}
+
+			void encode_arg(std::string &out, const std::string &value) { out += 's'; append_string_raw(out, value.data(), value.size()); }
+			void encode_arg(std::string &out, const char *value) { out += 's'; append_string_raw(out, value, value ? std::strlen(value) : 0); }
+			void encode_arg(std::string &out, char value) { out += 'c'; out += value; }
+			void encode_arg(std::string &out, bool value) { out += 'b'; out += value ? '1' : '0'; }
+			void encode_arg(std::string &out, short value) { out += 'i'; append_raw(out, static_cast<std::int64_t>(value)); }
+			void encode_arg(std::string &out, unsigned short value) { out += 'u'; append_raw(out, static_cast<std::uint64_t>(value)); }
+			void encode_arg(std::string &out, int value) { out += 'i'; append_raw(out, static_cast<std::int64_t>(value)); }
+			void encode_arg(std::string &out, unsigned int value) { out += 'u'; append_raw(out, static_cast<std::uint64_t>(value)); }
+			void encode_arg(std::string &out, long value) { out += 'i'; append_raw(out, static_cast<std::int64_t>(value)); }
+			void encode_arg(std::string &out, unsigned long value) { out += 'u'; append_raw(out, static_cast<std::uint64_t>(value)); }
+			void encode_arg(std::string &out, long long value) { out += 'i'; append_raw(out, static_cast<std::int64_t>(value)); }
+			void encode_arg(std::string &out, unsigned long long value) { out += 'u'; append_raw(out, static_cast<std::uint64_t>(value)); }
+			void encode_arg(std::string &out, float value) { out += 'f'; append_raw(out, static_cast<double>(value)); }
+			void encode_arg(std::string &out, double value) { out += 'f'; append_raw(out, value); }
+			void encode_arg(std::string &out, long double value) { out += 'f'; append_raw(out, static_cast<double>(value)); }
+
+			void append_json_string(std::string &out, const char *str, std::size_t size)
+			{
+				static const char *hex = "0123456789abcdef";
+				out += '"';
+				const char *end = str + size;
+				while (str < end)
+				{
+					// copy runs of plain characters at once
+					const char *run = str;
+					while (str < end && *str != '"' && *str != '\\' && static_cast<unsigned char>(*str) >= 0x20) ++str;
+					out.append(run, str);
+					if (str == end) break;
+					char c = *str++;
+					switch (c)
+					{
+					case '"': out += "\\\""; break;
+					case '\\': out += "\\\\"; break;
+					case '\n': out += "\\n"; break;
+					case '\r': out += "\\r"; break;
+					case '\t': out += "\\t"; break;
+					default:
+						out += "\\u00";
+						out += hex[(c >> 4) & 0xF];
+						out += hex[c & 0xF];
+						break;
+					}
+				}
+				out += '"';
+			}
+
+			bool append_encoded_arg(const char *&data, const char *end, std::string &out, bool json)
+			{
+				if (data == end) return false;
+				char tag = *data++;
+				if (tag == 's')
+				{
+					std::uint32_t len;
+					if (!read_raw(data, end, len) || static_cast<std::size_t>(end - data) < len) return false;
+					if (json) append_json_string(out, data, len);
+					else out.append(data, len);
+					data += len;
+				}
+				else if (tag == 'c')
+				{
+					if (data == end) return false;
+					if (json) append_json_string(out, data, 1);
+					else out += *data;
+					++data;
+				}
+				else if (tag == 'b')
+				{
+					if (data == end) return false;
+					if (json) out += (*data == '1') ? "true" : "false";
+					else out += *data;
+					++data;
+				}
+				else if (tag == 'i')
+				{
+					std::int64_t value;
+					if (!read_raw(data, end, value)) return false;
+					append_value(out, static_cast<long long>(value));
+				}
+				else if (tag == 'u')
+				{
+					std::uint64_t value;
+					if (!read_raw(data, end, value)) return false;
+					append_value(out, static_cast<unsigned long long>(value));
+				}
+				else if (tag == 'f')
+				{
+					double value;
+					if (!read_raw(data, end, value)) return false;
+					// json has no representation of nan and infinity
+					if (json && !std::isfinite(value)) out += "null";
+					else append_value(out, value);
+				}
+				else
+				{
+					return false;
+				}
+				return true;
+			}
+
+			bool decode_args(const std::string &fmt, const char *data, std::size_t size, std::string &out)
+			{
+				const char *end = data + size;
+				std::size_t pos = 0;
+				while (data < end)
+				{
+					// extra arguments are ignored, same as text formatting
+					if (!append_until_placeholder(out, fmt.c_str(), pos)) break;
+					if (!append_encoded_arg(data, end, out, false)) return false;
+				}
+				out += fmt.c_str() + pos;
+				return true;
+			}
+
+			void render_fields(const std::string &fields, std::string &out, bool json)
+			{
+				const char *data = fields.data();
+				const char *end = data + fields.size();
+				bool first = true;
+				while (data < end)
+				{
+					if (!first) out += json ? ',' : ' ';
+					first = false;
+					// fields are encoded by the same process, stop quietly if broken
+					if (!append_encoded_arg(data, end, out, json)) return;
+					out += json ? ':' : '=';
+					if (!append_encoded_arg(data, end, out, json)) return;
+				}
+			}
+
+			void render_json(const std::string &datetimeFormat, const LogMessage &msg, std::string &out)
+			{
+				out += "{\"time\":\"";
+				std::size_t start = out.size();
+				render_datetime(datetimeFormat, msg.timeStamp_, out);
+				// datetime is rendered in place, escape it only in the rare case it needs to be
+				for (std::size_t i = start; i < out.size(); ++i)
+				{
+					if (out[i] == '"' || out[i] == '\\' || static_cast<unsigned char>(out[i]) < 0x20)
+					{
+						std::string datetime(out, start);
+						out.resize(start - 1);
+						append_json_string(out, datetime.data(), datetime.size());
+						out.pop_back();
+						break;
+					}
+				}
+				out += "\",\"level\":\"";
+				out += consts::kLevelNames[msg.level_];
+				out += "\",\"logger\":";
+				append_json_string(out, msg.loggerName_.data(), msg.loggerName_.size());
+				out += ",\"thread\":";
+				if (msg.threadName_ && !msg.threadName_->empty()) append_json_string(out, msg.threadName_->data(), msg.threadName_->size());
+				else append_value(out, msg.threadId_);
+				out += ",\"msg\":";
+				append_json_string(out, msg.buffer_.data(), msg.buffer_.size());
+				// user keys are nested, so they never collide with the fixed keys above
+				if (!msg.fields_.empty())
+				{
+					out += ",\"fields\":{";
+					render_fields(msg.fields_, out, true);
+					out += '}';
+				}
+				out += '}';
+			}
+
+			BinaryFileSink::BinaryFileSink(const std::string filename, bool truncate) :fileEditor_(filename, truncate)
+			{
+				levelMask_ = 0x3F & LogConfig::instance().log_level_mask();
+				// each session starts with a header, format ids are only valid within the session
+				record_ = consts::kBinaryLogMagic;
+				record_ += static_cast<char>(consts::kBinaryLogVersion);
+				fileEditor_ << record_;
+			}
+
+			void BinaryFileSink::log(const LogMessage& msg)
+			{
+				if (!level_should_log(levelMask_, msg.level_))
+				{
+					stats_.filtered_.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				static const std::uint32_t plainFormat = register_binary_format("{}");
+
+				std::lock_guard<std::mutex> lock(mutex_);
+				std::uint32_t formatId = msg.formatId_;
+				const std::string *args = &msg.args_;
+				if (formatId == 0)
+				{
+					// stream style message, stored as the only argument
+					formatId = plainFormat;
+					textArgs_.clear();
+					encode_arg(textArgs_, msg.buffer_);
+					args = &textArgs_;
+				}
+
+				record_.clear();
+				if (formatId >= knownFormats_.size()) knownFormats_.resize(formatId + 1, false);
+				if (!knownFormats_[formatId])
+				{
+					std::string fmt = binary_format(formatId);
+					record_ += 'F';
+					append_raw(record_, formatId);
+					append_string_raw(record_, fmt.data(), fmt.size());
+					knownFormats_[formatId] = true;
+				}
+				record_ += 'M';
+				record_ += static_cast<char>(msg.level_);
+				append_raw(record_, static_cast<std::int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+					msg.timeStamp_.time_since_epoch()).count()));
+				append_raw(record_, static_cast<std::uint64_t>(msg.threadId_));
+				append_string_raw(record_, msg.loggerName_.data(), msg.loggerName_.size());
+				append_raw(record_, formatId);
+				append_string_raw(record_, args->data(), args->size());
+				bool timed = LogConfig::instance().latency_stats();
+				std::uint64_t start = timed ? steady_ns() : 0;
+				fileEditor_ << record_;
+				if (timed) stats_.latency_.record(steady_ns() - start);
+				stats_.accepted_.fetch_add(1, std::memory_order_relaxed);
+				stats_.bytes_.fetch_add(record_.size(), std::memory_order_relaxed);
+			}
+
+			void render_message(const CompiledFormat &format, const std::string &datetimeFormat, const LogMessage &msg, std::string &out)
+			{
+				std::size_t estimate = msg.buffer_.size() + msg.loggerName_.size() + 64;
+				for (auto &token : format) estimate += token.text_.size();
+				out.reserve(out.size() + estimate);
+				std::size_t start = out.size();
+
+				for (auto &token : format)
+				{
+					switch (token.type_)
+					{
+					case FormatToken::Type::literal:
+						out += token.text_;
+						break;
+					case FormatToken::Type::datetime:
+						render_datetime(datetimeFormat, msg.timeStamp_, out);
+						break;
+					case FormatToken::Type::logger:
+						out += msg.loggerName_;
+						break;
+					case FormatToken::Type::thread:
+						if (msg.threadName_ && !msg.threadName_->empty()) out += *msg.threadName_;
+						else append_value(out, msg.threadId_);
+						break;
+					case FormatToken::Type::level:
+						out += consts::kLevelNames[msg.level_];
+						break;
+					case FormatToken::Type::level_short:
+						out += consts::kShortLevelNames[msg.level_];
+						break;
+					case FormatToken::Type::message:
+						out += msg.buffer_;
+						break;
+					case FormatToken::Type::fields:
+						render_fields(msg.fields_, out, false);
+						break;
+					case FormatToken::Type::json:
+						render_json(datetimeFormat, msg, out);
+						break;
+					default:
+						break;
+					}
+				}
+				// make sure new line
+				if (out.size() == start || out.back() != '\n') out += os::endl();
+			}
+
+			AsyncSink::AsyncSink(SinkPtr sink, std::size_t queueSize, OverflowPolicy policy, LogLevels dropBelow)
+				:sink_(sink), queue_(queueSize)
+			{
+				name_ = consts::kAsyncSinkNamePrefix + sink_->name();
+				levelMask_ = LogLevels::sentinel;
+				format_.set(std::shared_ptr<const CompiledFormat>());
+				pending_ = 0;
+				reported_ = 0;
+				running_ = false;
+				set_overflow_policy(policy, dropBelow);
+				start();
+			}
+
+			AsyncSink::~AsyncSink()
+			{
+				stop();
+				sink_->flush();
+			}
+
+			void AsyncSink::log(const LogMessage& msg)
+			{
+				if (!level_should_log(levelMask_, msg.level_))
+				{
+					stats_.filtered_.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				LogMessage copy(msg);
+				consume(std::move(copy));
+			}
+
+			void AsyncSink::consume(LogMessage&& msg)
+			{
+				if (!level_should_log(levelMask_, msg.level_))
+				{
+					stats_.filtered_.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				++pending_;
+				if (queue_.enqueue(std::move(msg)))
+				{
+					stats_.accepted_.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+
+				// queue is full
+				switch (overflow_policy())
+				{
+				case OverflowPolicy::drop_newest:
+					break;
+				case OverflowPolicy::drop_oldest:
+				{
+					LogMessage oldest;
+					while (!queue_.enqueue(std::move(msg)))
+					{
+						if (queue_.dequeue(oldest))
+						{
+							--pending_;
+							stats_.dropped_.fetch_add(1, std::memory_order_relaxed);
+						}
+					}
+					stats_.accepted_.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				case OverflowPolicy::drop_below_level:
+					if (msg.level_ < dropBelow_) break;
+					enqueue_blocking(msg);
+					return;
+				default:
+					enqueue_blocking(msg);
+					return;
+				}
+				--pending_;
+				stats_.dropped_.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			void AsyncSink::enqueue_blocking(LogMessage &msg)
+			{
+				int retry = 0;
+				while (!queue_.enqueue(std::move(msg)))
+				{
+					// wait for worker to catch up
+					if (++retry < consts::kAsyncWorkerSpinCount)
+					{
+						std::this_thread::yield();
+					}
+					else
+					{
+						time::sleep(consts::kAsyncWorkerSleepInterval);
+					}
+				}
+				stats_.accepted_.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			void AsyncSink::report_dropped()
+			{
+				std::uint64_t dropped = stats_.dropped_;
+				if (dropped == reported_) return;
+				LogMessage msg;
+				msg.loggerName_ = consts::kZupplyInternalLoggerName;
+				msg.level_ = LogLevels::warn;
+				msg.timeStamp_ = std::chrono::system_clock::now();
+				msg.threadId_ = os::thread_id();
+				msg.threadName_ = &os::thread_name();
+				msg.buffer_ = "Async sink dropped " + std::to_string(dropped - reported_)
+					+ " messages due to queue overflow, total dropped: " + std::to_string(dropped);
+				reported_ = dropped;
+				write_backend(msg);
+			}
+
+			void AsyncSink::write_backend(const LogMessage &msg)
+			{
+				auto format = format_.get();
+				if (format) sink_->log_with_format(msg, format);
+				else sink_->log(msg);
+			}
+
+			void AsyncSink::flush()
+			{
+				while (pending_ > 0)
+				{
+					std::this_thread::yield();
+				}
+				sink_->flush();
+			}
+
+			void AsyncSink::start()
+			{
+				running_ = true;
+				worker_ = std::thread([this]{ this->bg_work(); });
+			}
+
+			void AsyncSink::stop()
+			{
+				if (running_)
+				{
+					running_ = false;
+					worker_.join();	// worker drains the queue before exit
+				}
+			}
+
+			void AsyncSink::bg_work()
+			{
+				LogMessage msg;
+				int idle = 0;
+				time::Timer reportTimer;
+				while (true)
+				{
+					if (reportTimer.elapsed_ms() > static_cast<std::size_t>(consts::kAsyncDropReportInterval))
+					{
+						report_dropped();
+						reportTimer.reset();
+					}
+
+					if (queue_.dequeue(msg))
+					{
+						try
+						{
+							write_backend(msg);
+						}
+						catch (...)
+						{
+							// worker must survive failures of backend sink
+						}
+						--pending_;
+						idle = 0;
+						continue;
+					}
+
+					// only quit when queue is drained
+					if (!running_)
+					{
+						report_dropped();
+						break;
+					}
+
+					if (++idle < consts::kAsyncWorkerSpinCount)
+					{
+						std::this_thread::yield();
+					}
+					else
+					{
+						time::sleep(consts::kAsyncWorkerSleepInterval);
+					}
+				}
+			}
+
+			void sink_list_revise(std::vector<std::string> &list, std::map<std::string, std::string> &map)
+			{
+				for (auto m : map)
+				{
+					for (auto l = list.begin(); l != list.end(); ++l)
+					{
+						if (m.first == *l)
+						{
+							l = list.erase(l);
+							l = list.insert(l, m.second);
+						}
+					}
+				}
+			}
+
+			void config_loggers_from_section(cfg::CfgLevel::section_map_t &section, std::map<std::string, std::string> &map)
+			{
+				for (auto loggerSec : section)
+				{
+					for (auto value : loggerSec.second.values)
+					{
+						LoggerPtr logger = nullptr;
+						if (consts::kConfigLevelsSpecifier == value.first)
+						{
+							int mask = level_mask_from_string(value.second.str());
+							if (!logger) logger = get_logger(loggerSec.first, true);
+							logger->set_level_mask(mask);
+						}
+						else if (consts::kConfigSinkListSpecifier == value.first)
+						{
+							auto list = fmt::split_whitespace(value.second.str());
+							if (list.empty()) continue;
+							sink_list_revise(list, map);
+							if (!logger) logger = get_logger(loggerSec.first, true);
+							logger->detach_all_sinks();
+							logger->attach_sink_list(list);
+						}
+						else
+						{
+							zupply_internal_warn("Unrecognized configuration key: " + value.first);
+						}
+					}
+				}
+			}
+
+			LoggerPtr get_hidden_logger()
+			{
+				auto hlogger = get_logger("hidden", false);
+				if (!hlogger)
+				{
+					hlogger = get_logger("hidden", true);
+					hlogger->set_level_mask(0);
+				}
+				return hlogger;
+			}
+
+			std::map<std::string, std::string> config_sinks_from_section(cfg::CfgLevel::section_map_t &section)
+			{
+				std::map<std::string, std::string> sinkMap;
+				// async sinks wrap other sinks, so they are created after all the others
+				std::map<std::string, std::string> asyncBackends;
+
+				auto register_sink = [&sinkMap](const std::string &secName, SinkPtr sink, const std::string &fmt, const std::string &levelStr)
+				{
+					if (!fmt.empty()) sink->set_format(fmt);
+					if (!levelStr.empty())
+					{
+						int mask = level_mask_from_string(levelStr);
+						sink->set_level_mask(mask);
+					}
+					if (!get_hidden_logger()->get_sink(sink->name()))
+					{
+						get_hidden_logger()->attach_sink(sink);
+					}
+					sinkMap[secName] = sink->name();
+				};
+
+				// optional entry, missing keys read as empty and are not inserted into the section
+				auto config_value = [](const cfg::CfgLevel &level, const char *key) -> cfg::Value
+				{
+					auto iter = level.values.find(key);
+					return iter == level.values.end() ? cfg::Value() : iter->second;
+				};
+
+				for (auto sinkSec : section)
+				{
+					std::string type;
+					std::string filename;
+					std::string fmt;
+					std::string levelStr;
+					std::string backend;
+					std::string queueSize;
+					std::string overflow;
+					std::string overflowLevel;
+					std::string capacity;
+					std::string bufferSize;
+					std::string flushInterval;
+					SinkPtr sink = nullptr;
+
+					for (auto value : sinkSec.second.values)
+					{
+						// entries
+						if (consts::kConfigSinkTypeSpecifier == value.first)
+						{
+							type = value.second.str();
+						}
+						else if (consts::kConfigSinkFilenameSpecifier == value.first)
+						{
+							filename = value.second.str();
+						}
+						else if (consts::kConfigFormatSpecifier == value.first)
+						{
+							fmt = value.second.str();
+						}
+						else if (consts::kConfigLevelsSpecifier == value.first)
+						{
+							levelStr = value.second.str();
+						}
+						else if (consts::kConfigSinkBackendSpecifier == value.first)
+						{
+							backend = value.second.str();
+						}
+						else if (consts::kConfigSinkCapacitySpecifier == value.first)
+						{
+							capacity = value.second.str();
+						}
+						else if (consts::kConfigSinkBufferSizeSpecifier == value.first)
+						{
+							bufferSize = value.second.str();
+						}
+						else if (consts::kConfigSinkFlushIntervalSpecifier == value.first)
+						{
+							flushInterval = value.second.str();
+						}
+						else if (consts::kConfigSinkLineSizeSpecifier == value.first)
+						{
+							// memory sink option, parsed along with memory sinks
+						}
+						else if (consts::kConfigSinkMaxSizeSpecifier == value.first
+							|| consts::kConfigSinkBackupSpecifier == value.first
+							|| consts::kConfigSinkRotateIntervalSpecifier == value.first
+							|| consts::kConfigSinkMaxBackupsSpecifier == value.first
+							|| consts::kConfigSinkCompressSpecifier == value.first)
+						{
+							// rotate file sink options, parsed along with rotate file sinks
+						}
+						else if (consts::kConfigSinkQueueSizeSpecifier == value.first
+							|| consts::kConfigSinkOverflowSpecifier == value.first
+							|| consts::kConfigSinkOverflowLevelSpecifier == value.first)
+						{
+							// async sink options, parsed along with async sinks
+						}
+						else
+						{
+							zupply_internal_warn("Unrecognized config key entry: " + value.first);
+						}
+					}
+
+					// sink
+					if (type.empty()) throw RuntimeException("No suitable type specified for sink: " + sinkSec.first);
+					if (type == consts::kAsyncSinkType)
+					{
+						if (backend.empty()) throw RuntimeException("No backend specified for async sink: " + sinkSec.first);
+						asyncBackends[sinkSec.first] = backend;
+						continue;
+					}
+					else if (type == consts::kStdoutSinkName)
+					{
+						sink = new_stdout_sink();
+					}
+					else if (type == consts::kStderrSinkName)
 					{
 						sink = new_stderr_sink();
 					}
+					else if (type == consts::kNullSinkType)
+					{
+						sink = new_null_sink(sinkSec.first);
+					}
+					else if (type == consts::kMemorySinkType)
+					{
+						std::size_t lines = consts::kMemorySinkCapacity;
+						if (!config_value(sinkSec.second, consts::kConfigSinkCapacitySpecifier).str().empty())
+						{
+							lines = config_value(sinkSec.second, consts::kConfigSinkCapacitySpecifier).load<std::size_t>();
+						}
+						std::size_t lineSize = consts::kMemorySinkLineSize;
+						if (!config_value(sinkSec.second, consts::kConfigSinkLineSizeSpecifier).str().empty())
+						{
+							lineSize = config_value(sinkSec.second, consts::kConfigSinkLineSizeSpecifier).load<std::size_t>();
+						}
+						sink = new_memory_sink(sinkSec.first, lines, lineSize);
+					}
 					else
 					{
 						if (filename.empty()) throw RuntimeException("No name specified for sink: " + sinkSec.first);
@@ -13426,14 +14875,57 @@ namespace zz
 						{
 							zupply_internal_warn("Currently do not support init ostream logger from config file.");
 						}
-						else if (type == consts::kSimplefileSinkType)
+						else if (type == consts::kSimplefileSinkType || type == consts::kRotatefileSinkType)
+						{
+							std::size_t batchSize = 0;
+							if (!bufferSize.empty()) batchSize = config_value(sinkSec.second, consts::kConfigSinkBufferSizeSpecifier).load<std::size_t>();
+							int interval = consts::kFileSinkFlushInterval;
+							if (!flushInterval.empty()) interval = config_value(sinkSec.second, consts::kConfigSinkFlushIntervalSpecifier).load<int>();
+							if (type == consts::kSimplefileSinkType)
+							{
+								sink = new_simple_file_sink(filename, false, batchSize, interval);
+							}
+							else
+							{
+								std::size_t maxSize = consts::kRotateFileMaxSize;
+								if (!config_value(sinkSec.second, consts::kConfigSinkMaxSizeSpecifier).str().empty())
+								{
+									maxSize = config_value(sinkSec.second, consts::kConfigSinkMaxSizeSpecifier).load<std::size_t>();
+								}
+								bool backup = false;
+								if (!config_value(sinkSec.second, consts::kConfigSinkBackupSpecifier).str().empty())
+								{
+									backup = config_value(sinkSec.second, consts::kConfigSinkBackupSpecifier).load<bool>();
+								}
+								RotateInterval rotateInterval = RotateInterval::none;
+								if (!config_value(sinkSec.second, consts::kConfigSinkRotateIntervalSpecifier).str().empty())
+								{
+									rotateInterval = rotate_interval_from_str(config_value(sinkSec.second, consts::kConfigSinkRotateIntervalSpecifier).str());
+								}
+								std::size_t maxBackups = 0;
+								if (!config_value(sinkSec.second, consts::kConfigSinkMaxBackupsSpecifier).str().empty())
+								{
+									maxBackups = config_value(sinkSec.second, consts::kConfigSinkMaxBackupsSpecifier).load<std::size_t>();
+								}
+								bool compress = false;
+								if (!config_value(sinkSec.second, consts::kConfigSinkCompressSpecifier).str().empty())
+								{
+									compress = config_value(sinkSec.second, consts::kConfigSinkCompressSpecifier).load<bool>();
+								}
+								sink = new_rotate_file_sink(filename, maxSize, backup, batchSize, interval, rotateInterval, maxBackups, compress);
+							}
+							get_hidden_logger()->attach_sink(sink);
+						}
+						else if (type == consts::kBinaryfileSinkType)
 						{
-							sink = new_simple_file_sink(filename);
+							sink = new_binary_file_sink(filename);
 							get_hidden_logger()->attach_sink(sink);
 						}
-						else if (type == consts::kRotatefileSinkType)
+						else if (type == consts::kRingfileSinkType)
 						{
-							sink = new_rotate_file_sink(filename);
+							std::size_t ringCapacity = consts::kRingLogDefaultCapacity;
+							if (!capacity.empty()) ringCapacity = config_value(sinkSec.second, consts::kConfigSinkCapacitySpecifier).load<std::size_t>();
+							sink = new_ring_file_sink(filename, ringCapacity);
 							get_hidden_logger()->attach_sink(sink);
 						}
 						else
@@ -13443,18 +14935,37 @@ namespace zz
 					}
 					if (sink)
 					{
-						if (!fmt.empty()) sink->set_format(fmt);
-						if (!levelStr.empty())
-						{
-							int mask = level_mask_from_string(levelStr);
-							sink->set_level_mask(mask);
-						}
-						if (!get_hidden_logger()->get_sink(sink->name()))
-						{
-							get_hidden_logger()->attach_sink(sink);
-						}
-						sinkMap[sinkSec.first] = sink->name();
+						register_sink(sinkSec.first, sink, fmt, levelStr);
+					}
+				}
+
+				for (auto async : asyncBackends)
+				{
+					auto iter = sinkMap.find(async.second);
+					SinkPtr backendSink = (iter == sinkMap.end()) ? nullptr : get_sink(iter->second);
+					if (!backendSink)
+					{
+						zupply_internal_warn("Backend sink: " + async.second + " not found for async sink: " + async.first);
+						continue;
 					}
+					auto &asyncSec = section.at(async.first);
+					std::size_t queueSize = consts::kAsyncQueueSize;
+					if (!config_value(asyncSec, consts::kConfigSinkQueueSizeSpecifier).str().empty())
+					{
+						queueSize = config_value(asyncSec, consts::kConfigSinkQueueSizeSpecifier).load<int>();
+					}
+					OverflowPolicy policy = OverflowPolicy::block;
+					if (!config_value(asyncSec, consts::kConfigSinkOverflowSpecifier).str().empty())
+					{
+						policy = overflow_policy_from_str(config_value(asyncSec, consts::kConfigSinkOverflowSpecifier).str());
+					}
+					LogLevels dropBelow = LogLevels::warn;
+					if (!config_value(asyncSec, consts::kConfigSinkOverflowLevelSpecifier).str().empty())
+					{
+						dropBelow = level_from_str(config_value(asyncSec, consts::kConfigSinkOverflowLevelSpecifier).str());
+					}
+					register_sink(async.first, new_async_sink(backendSink, queueSize, policy, dropBelow),
+						config_value(asyncSec, consts::kConfigFormatSpecifier).str(), config_value(asyncSec, consts::kConfigLevelsSpecifier).str());
 				}
 				return sinkMap;
 			}
@@ -13483,6 +14994,168 @@ namespace zz
 #endif
 			format_.set(std::string(consts::kDefaultLoggerFormat));
 			datetimeFormat_.set(std::string(consts::kDefaultLoggerDatetimeFormat));
+			latencyStats_ = false;
+		}
+
+		namespace detail
+		{
+			int latency_bucket(std::uint64_t ns)
+			{
+				const std::uint64_t subCount = 1ull << consts::kLatencySubBucketBits;
+				if (ns < subCount) return static_cast<int>(ns);
+				int msb = 63;
+#if defined(__GNUC__)
+				msb = 63 - __builtin_clzll(static_cast<unsigned long long>(ns));
+#else
+				while (!(ns >> msb)) --msb;
+#endif
+				int shift = msb - consts::kLatencySubBucketBits;
+				return ((shift + 1) << consts::kLatencySubBucketBits) + static_cast<int>((ns >> shift) - subCount);
+			}
+
+			std::uint64_t latency_bucket_upper(int bucket)
+			{
+				const int subCount = 1 << consts::kLatencySubBucketBits;
+				if (bucket < subCount) return static_cast<std::uint64_t>(bucket);
+				int shift = (bucket >> consts::kLatencySubBucketBits) - 1;
+				std::uint64_t sub = static_cast<std::uint64_t>((bucket & (subCount - 1)) + subCount);
+				return ((sub + 1) << shift) - 1;
+			}
+
+			std::string format_latency(double ns)
+			{
+				static const char *units[] = { "ns", "us", "ms", "s" };
+				int unit = 0;
+				while (ns >= 1000 && unit < 3)
+				{
+					ns /= 1000;
+					++unit;
+				}
+				char buf[32];
+				std::snprintf(buf, sizeof(buf), "%.3g%s", ns, units[unit]);
+				return buf;
+			}
+		} // namespace detail
+
+		void LatencyHistogram::record(std::uint64_t ns)
+		{
+			buckets_[detail::latency_bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+			count_.fetch_add(1, std::memory_order_relaxed);
+			sum_.fetch_add(ns, std::memory_order_relaxed);
+			std::uint64_t prev = max_.load(std::memory_order_relaxed);
+			while (ns > prev && !max_.compare_exchange_weak(prev, ns, std::memory_order_relaxed));
+		}
+
+		double LatencyHistogram::mean() const
+		{
+			std::uint64_t n = count();
+			return n > 0 ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / n : 0;
+		}
+
+		std::uint64_t LatencyHistogram::percentile(double percent) const
+		{
+			std::uint64_t total = 0;
+			std::uint64_t counts[consts::kLatencyBucketCount];
+			for (int i = 0; i < consts::kLatencyBucketCount; ++i)
+			{
+				counts[i] = buckets_[i].load(std::memory_order_relaxed);
+				total += counts[i];
+			}
+			if (total < 1) return 0;
+			percent = (std::min)(100.0, (std::max)(0.0, percent));
+			std::uint64_t rank = static_cast<std::uint64_t>(std::ceil(percent / 100 * total));
+			if (rank < 1) rank = 1;
+			std::uint64_t seen = 0;
+			for (int i = 0; i < consts::kLatencyBucketCount; ++i)
+			{
+				seen += counts[i];
+				if (seen >= rank) return (std::min)(detail::latency_bucket_upper(i), max());
+			}
+			return max();
+		}
+
+		void LatencyHistogram::merge(const LatencyHistogram &other)
+		{
+			for (int i = 0; i < consts::kLatencyBucketCount; ++i)
+			{
+				std::uint64_t n = other.buckets_[i].load(std::memory_order_relaxed);
+				if (n > 0) buckets_[i].fetch_add(n, std::memory_order_relaxed);
+			}
+			count_.fetch_add(other.count(), std::memory_order_relaxed);
+			sum_.fetch_add(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			std::uint64_t otherMax = other.max();
+			std::uint64_t prev = max_.load(std::memory_order_relaxed);
+			while (otherMax > prev && !max_.compare_exchange_weak(prev, otherMax, std::memory_order_relaxed));
+		}
+
+		void LatencyHistogram::reset()
+		{
+			for (auto &bucket : buckets_) bucket.store(0, std::memory_order_relaxed);
+			count_ = 0;
+			sum_ = 0;
+			max_ = 0;
+		}
+
+		std::string LatencyHistogram::to_string() const
+		{
+			if (count() < 1) return "latency: n/a";
+			return "latency: mean " + detail::format_latency(mean())
+				+ " p50 " + detail::format_latency(static_cast<double>(percentile(50)))
+				+ " p99 " + detail::format_latency(static_cast<double>(percentile(99)))
+				+ " p999 " + detail::format_latency(static_cast<double>(percentile(99.9)))
+				+ " max " + detail::format_latency(static_cast<double>(max()));
+		}
+
+		void LogStats::reset()
+		{
+			accepted_ = 0;
+			filtered_ = 0;
+			dropped_ = 0;
+			bytes_ = 0;
+			latency_.reset();
+		}
+
+		bool LogSite::pass(bool logged, std::uint64_t &suppressed)
+		{
+			if (logged)
+			{
+				suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+			}
+			else
+			{
+				suppressed_.fetch_add(1, std::memory_order_relaxed);
+			}
+			return logged;
+		}
+
+		bool LogSite::every_n(std::uint64_t n, std::uint64_t &suppressed)
+		{
+			std::uint64_t count = count_.fetch_add(1, std::memory_order_relaxed);
+			return pass(n < 2 || count % n == 0, suppressed);
+		}
+
+		bool LogSite::every(std::int64_t intervalNs, std::uint64_t &suppressed)
+		{
+			std::int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+			std::int64_t next = next_.load(std::memory_order_relaxed);
+			// only the thread winning the exchange logs
+			bool logged = now >= next && next_.compare_exchange_strong(next, now + intervalNs, std::memory_order_relaxed);
+			return pass(logged, suppressed);
+		}
+
+		bool LogSite::first_n(std::uint64_t n, std::uint64_t thenEveryN, std::uint64_t &suppressed)
+		{
+			std::uint64_t count = count_.fetch_add(1, std::memory_order_relaxed);
+			if (count < n) return pass(true, suppressed);
+			return pass(thenEveryN > 0 && (count - n + 1) % thenEveryN == 0, suppressed);
+		}
+
+		std::string LogStats::to_string() const
+		{
+			return "accepted: " + std::to_string(accepted_.load()) + " filtered: " + std::to_string(filtered_.load())
+				+ " dropped: " + std::to_string(dropped_.load()) + " bytes: " + std::to_string(bytes_.load())
+				+ " " + latency_.to_string();
 		}
 
 		LogConfig& LogConfig::instance()
@@ -13542,6 +15215,11 @@ namespace zz
 		}
 
 		std::string LogConfig::datetime_format()
+		{
+			return *datetimeFormat_.get();
+		}
+
+		std::shared_ptr<const std::string> LogConfig::datetime_format_ptr()
 		{
 			return datetimeFormat_.get();
 		}
@@ -13579,17 +15257,64 @@ namespace zz
 
 		SinkPtr Logger::get_sink(std::string name)
 		{
-			SinkPtr ptr;
-			if (sinks_.get(name, ptr))
+			auto list = sinks_.get();
+			for (auto &sink : list->sinks_)
 			{
-				return ptr;
+				if (sink->name() == name) return sink;
 			}
 			return nullptr;
 		}
 
+		bool Logger::insert_sink(SinkPtr sink)
+		{
+			std::string name = sink->name();
+			bool ret = sinks_.modify([&](SinkList &list)
+			{
+				for (auto &s : list.sinks_)
+				{
+					if (s->name() == name) return false;
+				}
+				list.sinks_.push_back(sink);
+				list.update_kinds();
+				return true;
+			});
+			publish_sink_kinds(*sinks_.get());
+			return ret;
+		}
+
+		void Logger::erase_sink(const std::string &name)
+		{
+			sinks_.modify([&](SinkList &list)
+			{
+				auto iter = std::find_if(list.sinks_.begin(), list.sinks_.end(), [&](const SinkPtr &s){ return s->name() == name; });
+				if (iter == list.sinks_.end()) return false;
+				list.sinks_.erase(iter);
+				list.update_kinds();
+				return true;
+			});
+			publish_sink_kinds(*sinks_.get());
+		}
+
+		void Logger::SinkList::update_kinds()
+		{
+			text_ = false;
+			binary_ = false;
+			for (auto &sink : sinks_)
+			{
+				if (sink->is_binary()) binary_ = true;
+				else text_ = true;
+			}
+		}
+
+		void Logger::publish_sink_kinds(const SinkList &list)
+		{
+			textSinks_ = list.text_;
+			binarySinks_ = list.binary_;
+		}
+
 		void Logger::attach_sink(SinkPtr sink)
 		{
-			if (!sinks_.insert(sink->name(), sink))
+			if (!insert_sink(sink))
 			{
 				throw RuntimeException("Sink with name: " + sink->name() + " already attached to logger: " + name_);
 			}
@@ -13597,31 +15322,48 @@ namespace zz
 
 		void Logger::detach_sink(SinkPtr sink)
 		{
-			sinks_.erase(sink->name());
+			erase_sink(sink->name());
 		}
 
 		void Logger::detach_all_sinks()
 		{
-			sinks_.clear();
+			sinks_.set(SinkList());
+			publish_sink_kinds(*sinks_.get());
 		}
 
-		void Logger::log_msg(detail::LogMessage msg)
+		void Logger::log_msg(detail::LogMessage &&msg)
 		{
-			auto sinks = sinks_.snapshot();
-			for (auto s : sinks)
+			stats_.accepted_.fetch_add(1, std::memory_order_relaxed);
+			auto list = sinks_.get();
+			auto sinks = &list->sinks_;
+			if (sinks->empty()) return;
+			if (list->text_ && msg.formatId_ != 0 && msg.buffer_.empty())
+			{
+				// text sinks attached after the line skipped rendering
+				detail::decode_args(detail::binary_format(msg.formatId_), msg.args_.data(), msg.args_.size(), msg.buffer_);
+			}
+			bool timed = LogConfig::instance().latency_stats();
+			std::uint64_t start = timed ? detail::steady_ns() : 0;
+			detail::RenderScope scope;
+			// message is shared among sinks, only the last one may take it over
+			for (auto s = sinks->begin(); s != sinks->end() - 1; ++s)
 			{
-				s.second->log(msg);
+				(*s)->log(msg);
 			}
+			sinks->back()->consume(std::move(msg));
+			if (timed) stats_.latency_.record(detail::steady_ns() - start);
 		}
 
-		std::string Logger::to_string()
+		std::string Logger::to_string(bool withStats)
 		{
 			std::string str(name() + ": " + level_mask_to_string(levelMask_));
+			if (withStats) str += "\n" + stats_.to_string();
 			str += "\n{\n";
-			auto sinkmap = sinks_.snapshot();
-			for (auto sink : sinkmap)
+			auto list = sinks_.get();
+			for (auto &sink : list->sinks_)
 			{
-				str += sink.second->to_string() + "\n";
+				str += sink->to_string() + "\n";
+				if (withStats) str += "\t" + sink->stats().to_string() + "\n";
 			}
 			str += "}";
 			return str;
@@ -13666,6 +15408,32 @@ namespace zz
 			return mask & LogLevels::sentinel;
 		}
 
+		OverflowPolicy overflow_policy_from_str(std::string policy)
+		{
+			std::string lowerPolicy = fmt::to_lower_ascii(fmt::trim(policy));
+			for (int i = 0; i <= static_cast<int>(OverflowPolicy::drop_below_level); ++i)
+			{
+				if (lowerPolicy == consts::kOverflowPolicyNames[i])
+				{
+					return static_cast<OverflowPolicy>(i);
+				}
+			}
+			throw ArgException("Unrecognized overflow policy: " + policy);
+		}
+
+		RotateInterval rotate_interval_from_str(std::string interval)
+		{
+			std::string lowerInterval = fmt::to_lower_ascii(fmt::trim(interval));
+			for (int i = 0; i <= static_cast<int>(RotateInterval::daily); ++i)
+			{
+				if (lowerInterval == consts::kRotateIntervalNames[i])
+				{
+					return static_cast<RotateInterval>(i);
+				}
+			}
+			throw ArgException("Unrecognized rotate interval: " + interval);
+		}
+
 		LoggerPtr get_logger(std::string name, bool createIfNotExists)
 		{
 			if (createIfNotExists)
@@ -13678,6 +15446,24 @@ namespace zz
 			}
 		}
 
+		Logger* LoggerHandle::resolve() const
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			// read before lookup, a drop in between only causes another lookup
+			std::uint64_t generation = detail::LoggerRegistry::instance().generation();
+			Logger *logger = logger_.load(std::memory_order_relaxed);
+			if (logger && generation_.load(std::memory_order_relaxed) == generation) return logger;
+			LoggerPtr current = get_logger(name_);
+			if (current != holder_)
+			{
+				if (holder_) retired_.push_back(holder_);
+				holder_ = current;
+			}
+			logger_.store(holder_.get(), std::memory_order_release);
+			generation_.store(generation, std::memory_order_release);
+			return holder_.get();
+		}
+
 		SinkPtr new_stdout_sink()
 		{
 			return detail::StdoutSink::instance();
@@ -13690,14 +15476,14 @@ namespace zz
 
 		void Logger::attach_console()
 		{
-			sinks_.insert(std::string(consts::kStdoutSinkName), new_stdout_sink());
-			sinks_.insert(std::string(consts::kStderrSinkName), new_stderr_sink());
+			insert_sink(new_stdout_sink());
+			insert_sink(new_stderr_sink());
 		}
 
 		void Logger::detach_console()
 		{
-			sinks_.erase(std::string(consts::kStdoutSinkName));
-			sinks_.erase(std::string(consts::kStderrSinkName));
+			erase_sink(consts::kStdoutSinkName);
+			erase_sink(consts::kStderrSinkName);
 		}
 
 		SinkPtr get_sink(std::string name)
@@ -13715,13 +15501,13 @@ namespace zz
 			return nullptr;
 		}
 
-		void dump_loggers(std::ostream &out)
+		void dump_loggers(std::ostream &out, bool withStats)
 		{
 			auto loggers = detail::LoggerRegistry::instance().get_all();
 			out << "{\n";
 			for (auto logger : loggers)
 			{
-				out << logger->to_string() << "\n";
+				out << logger->to_string(withStats) << "\n";
 			}
 			out << "}" << std::endl;
 		}
@@ -13736,24 +15522,205 @@ namespace zz
 			return std::make_shared<detail::OStreamSink>(stream, name.c_str(), forceFlush);
 		}
 
-		SinkPtr new_simple_file_sink(std::string filename, bool truncate)
+		SinkPtr new_simple_file_sink(std::string filename, bool truncate, std::size_t bufferSize, int flushInterval)
+		{
+			auto sinkptr = get_sink(os::absolute_path(filename));
+			if (sinkptr)
+			{
+				throw RuntimeException("File: " + filename + " already holded by another sink!\n" + sinkptr->to_string());
+			}
+			sinkptr = std::make_shared<detail::SimpleFileSink>(filename, truncate, bufferSize);
+			if (bufferSize > 0 && flushInterval > 0) detail::SinkFlusher::instance().add(sinkptr, flushInterval);
+			return sinkptr;
+		}
+
+		SinkPtr new_rotate_file_sink(std::string filename, std::size_t maxSizeInByte, bool backupOld, std::size_t bufferSize, int flushInterval,
+			RotateInterval interval, std::size_t maxBackups, bool compressBackups)
+		{
+			auto sinkptr = get_sink(os::absolute_path(filename));
+			if (sinkptr)
+			{
+				throw RuntimeException("File: " + filename + " already holded by another sink!\n" + sinkptr->to_string());
+			}
+			sinkptr = std::make_shared<detail::RotateFileSink>(filename, maxSizeInByte, backupOld, bufferSize, interval, maxBackups, compressBackups);
+			if (bufferSize > 0 && flushInterval > 0) detail::SinkFlusher::instance().add(sinkptr, flushInterval);
+			return sinkptr;
+		}
+
+		SinkPtr new_async_sink(SinkPtr sink, std::size_t queueSize, OverflowPolicy policy, LogLevels dropBelow)
+		{
+			if (!sink) throw ArgException("Null backend sink for async sink.");
+			auto sinkptr = get_sink(consts::kAsyncSinkNamePrefix + sink->name());
+			if (sinkptr)
+			{
+				throw RuntimeException("Sink: " + sink->name() + " already wrapped by another async sink!\n" + sinkptr->to_string());
+			}
+			return std::make_shared<detail::AsyncSink>(sink, queueSize, policy, dropBelow);
+		}
+
+		SinkPtr new_binary_file_sink(std::string filename, bool truncate)
 		{
 			auto sinkptr = get_sink(os::absolute_path(filename));
 			if (sinkptr)
 			{
 				throw RuntimeException("File: " + filename + " already holded by another sink!\n" + sinkptr->to_string());
 			}
-			return std::make_shared<detail::SimpleFileSink>(filename, truncate);
+			return std::make_shared<detail::BinaryFileSink>(filename, truncate);
 		}
 
-		SinkPtr new_rotate_file_sink(std::string filename, std::size_t maxSizeInByte, bool backupOld)
+		SinkPtr new_ring_file_sink(std::string filename, std::size_t capacity)
 		{
 			auto sinkptr = get_sink(os::absolute_path(filename));
 			if (sinkptr)
 			{
 				throw RuntimeException("File: " + filename + " already holded by another sink!\n" + sinkptr->to_string());
 			}
-			return std::make_shared<detail::RotateFileSink>(filename, maxSizeInByte, backupOld);
+			if (capacity < 1) throw ArgException("Ring file capacity must be positive.");
+			return std::make_shared<detail::RingFileSink>(filename, capacity);
+		}
+
+		std::string read_ring_log(std::string filename)
+		{
+			std::ifstream in;
+			os::ifstream_open(in, filename, std::ios::in | std::ios::binary);
+			if (!in.is_open()) throw RuntimeException("Unable to open ring log: " + filename);
+			detail::RingLogHeader header;
+			char reserved[consts::kRingLogHeaderSize];
+			if (!in.read(reserved, consts::kRingLogHeaderSize)) throw RuntimeException("Invalid ring log: " + filename);
+			std::memcpy(&header, reserved, sizeof(header));
+			if (std::strncmp(header.magic_, consts::kRingLogMagic, sizeof(header.magic_)) != 0 || header.capacity_ < 1)
+			{
+				throw RuntimeException("Invalid ring log header: " + filename);
+			}
+			std::string ring(static_cast<std::size_t>(header.capacity_), '\0');
+			if (!in.read(&ring[0], ring.size())) throw RuntimeException("Truncated ring log: " + filename);
+
+			if (header.writePos_ <= header.capacity_)
+			{
+				return ring.substr(0, static_cast<std::size_t>(header.writePos_));
+			}
+			// wrapped, oldest data starts at write offset
+			std::size_t offset = static_cast<std::size_t>(header.writePos_ % header.capacity_);
+			std::string unwrapped = ring.substr(offset) + ring.substr(0, offset);
+			auto firstLine = unwrapped.find('\n');
+			if (firstLine == std::string::npos) return unwrapped;
+			return unwrapped.substr(firstLine + 1);
+		}
+
+		SinkPtr new_null_sink(std::string name)
+		{
+			auto sinkptr = get_sink(name);
+			if (sinkptr)
+			{
+				throw RuntimeException("Sink: " + name + " already exists!\n" + sinkptr->to_string());
+			}
+			return std::make_shared<detail::NullSink>(name);
+		}
+
+		SinkPtr new_memory_sink(std::string name, std::size_t capacity, std::size_t lineSize)
+		{
+			auto sinkptr = get_sink(name);
+			if (sinkptr)
+			{
+				throw RuntimeException("Sink: " + name + " already exists!\n" + sinkptr->to_string());
+			}
+			if (capacity < 1 || lineSize < 1) throw ArgException("Memory sink capacity and line size must be positive.");
+			return std::make_shared<detail::MemorySink>(name, capacity, lineSize);
+		}
+
+		std::vector<std::string> read_memory_sink(SinkPtr sink)
+		{
+			auto async = std::dynamic_pointer_cast<detail::AsyncSink>(sink);
+			if (async) sink = async->backend();
+			auto memory = std::dynamic_pointer_cast<detail::MemorySink>(sink);
+			if (!memory) throw ArgException("Not a memory sink: " + (sink ? sink->name() : std::string("null")));
+			return memory->lines();
+		}
+
+		std::vector<std::string> read_memory_sink(std::string name)
+		{
+			auto sink = get_sink(name);
+			if (!sink) throw ArgException("Sink not found: " + name);
+			return read_memory_sink(sink);
+		}
+
+		std::size_t decode_binary_log(std::istream &in, std::ostream &out, const std::string &format, const std::string &datetimeFormat)
+		{
+			auto compiled = detail::compile_format(format);
+			std::unordered_map<std::uint32_t, std::string> formats;
+			detail::LogMessage msg;
+			msg.threadName_ = nullptr;
+			std::string args;
+			std::string line;
+			std::size_t count = 0;
+			bool session = false;
+			char type;
+
+			// stop silently at incomplete record, the writer may have crashed
+			while (in.get(type))
+			{
+				if (type == consts::kBinaryLogMagic[0])
+				{
+					char header[5];
+					header[0] = type;
+					if (!in.read(header + 1, 4)) break;
+					if (std::strncmp(header, consts::kBinaryLogMagic, 4) != 0)
+					{
+						throw RuntimeException("Invalid binary log header.");
+					}
+					if (header[4] != consts::kBinaryLogVersion)
+					{
+						throw RuntimeException("Unsupported binary log version: " + std::to_string(static_cast<int>(header[4])));
+					}
+					formats.clear();
+					session = true;
+				}
+				else if (!session)
+				{
+					throw RuntimeException("Binary log header not found.");
+				}
+				else if (type == 'F')
+				{
+					std::uint32_t id;
+					std::string fmt;
+					if (!detail::read_raw(in, id) || !detail::read_string(in, fmt)) break;
+					formats[id] = fmt;
+				}
+				else if (type == 'M')
+				{
+					char level;
+					std::int64_t timeStamp;
+					std::uint64_t threadId;
+					std::uint32_t formatId;
+					if (!in.get(level) || !detail::read_raw(in, timeStamp) || !detail::read_raw(in, threadId)
+						|| !detail::read_string(in, msg.loggerName_) || !detail::read_raw(in, formatId)
+						|| !detail::read_string(in, args)) break;
+
+					auto iter = formats.find(formatId);
+					if (level < 0 || level >= LogLevels::off || iter == formats.end())
+					{
+						throw RuntimeException("Corrupted binary log message.");
+					}
+					msg.level_ = static_cast<LogLevels>(level);
+					msg.timeStamp_ = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+						std::chrono::microseconds(timeStamp)));
+					msg.threadId_ = static_cast<std::size_t>(threadId);
+					msg.buffer_.clear();
+					if (!detail::decode_args(iter->second, args.data(), args.size(), msg.buffer_))
+					{
+						throw RuntimeException("Corrupted binary log arguments.");
+					}
+					line.clear();
+					detail::render_message(compiled, datetimeFormat, msg, line);
+					out << line;
+					++count;
+				}
+				else
+				{
+					throw RuntimeException("Corrupted binary log, unknown record type.");
+				}
+			}
+			return count;
 		}
 
 		void Logger::attach_sink_list(std::vector<std::string> &sinkList)
@@ -13795,6 +15762,7 @@ namespace zz
 		void drop_all_loggers()
 		{
 			detail::LoggerRegistry::instance().drop_all();
+			detail::SinkFlusher::instance().stop();
 		}
 
 		void drop_sink(std::string name)
@@ -13851,6 +15819,318 @@ namespace zz
 
 	} // namespace log
 
+	namespace detail
+	{
+		/*!
+		 * \brief The AlignedImageAllocator class, aligned heap storage for images
+		 */
+		class AlignedImageAllocator : public ImageAllocator
+		{
+		public:
+			void* allocate(std::size_t size, std::size_t alignment) override
+			{
+#if ZUPPLY_OS_WINDOWS
+				void *p = ::_aligned_malloc(size, alignment);
+#else
+				void *p = nullptr;
+				if (::posix_memalign(&p, alignment, size) != 0) p = nullptr;
+#endif
+				if (!p) throw MemException("Failed to allocate " + std::to_string(size) + " bytes for image");
+				return p;
+			}
+
+			void deallocate(void* p, std::size_t, std::size_t) override
+			{
+				// aligned blocks are freed by address only
+#if ZUPPLY_OS_WINDOWS
+				::_aligned_free(p);
+#else
+				::free(p);
+#endif
+			}
+		};
+	} // namespace detail
+
+	namespace detail
+	{
+		ImageAllocatorPtr& aligned_image_allocator()
+		{
+			static ImageAllocatorPtr instance = std::make_shared<AlignedImageAllocator>();
+			return instance;
+		}
+
+		ImageAllocatorPtr& default_image_allocator()
+		{
+			static ImageAllocatorPtr instance = aligned_image_allocator();
+			return instance;
+		}
+	} // namespace detail
+
+	namespace detail
+	{
+		/*!
+		 * \brief The BandRunner class, persistent workers splitting one job into bands.
+		 * One job runs at a time, concurrent callers fall back to their own thread.
+		 * Workers are started on first use and joined by stop(), never in a static destructor.
+		 */
+		class BandRunner : private UnMovable
+		{
+		public:
+			static BandRunner& instance()
+			{
+				// leaked on purpose, joining threads in static destructor deadlocks in VC12
+				static BandRunner *instance_ = new BandRunner();
+				return *instance_;
+			}
+
+			int concurrency() const
+			{
+				return (std::max)(1, static_cast<int>(std::thread::hardware_concurrency()));
+			}
+
+			void run(int count, const std::function<void(int)>& job)
+			{
+				std::unique_lock<std::mutex> runLock(runMutex_, std::try_to_lock);
+				if (count < 2 || !runLock.owns_lock() || !start())
+				{
+					for (int i = 0; i < count; ++i) job(i);
+					return;
+				}
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					job_ = &job;
+					count_ = count;
+					next_ = 0;
+					active_ = static_cast<int>(workers_.size());
+					++generation_;
+				}
+				cv_.notify_all();
+				work_on(job, count);
+				std::unique_lock<std::mutex> lock(mutex_);
+				doneCv_.wait(lock, [this]{ return active_ == 0; });
+				job_ = nullptr;
+			}
+
+			void stop()
+			{
+				std::lock_guard<std::mutex> runLock(runMutex_);
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					stop_ = true;
+				}
+				cv_.notify_all();
+				for (auto& w : workers_) w.join();
+				workers_.clear();
+				std::lock_guard<std::mutex> lock(mutex_);
+				stop_ = false;
+			}
+
+		private:
+			BandRunner() : job_(nullptr), count_(0), next_(0), active_(0), generation_(0), seen_(0), stop_(false) {}
+
+			/*!
+			 * \brief Start workers if not running, must hold runMutex_
+			 * \return True if there are workers to share the job
+			 */
+			bool start()
+			{
+				if (workers_.empty())
+				{
+					{
+						std::lock_guard<std::mutex> lock(mutex_);
+						// new workers only pick up jobs posted after they start
+						seen_ = generation_;
+					}
+					int n = concurrency() - 1;
+					for (int i = 0; i < n; ++i) workers_.push_back(std::thread(&BandRunner::run_worker, this));
+				}
+				return !workers_.empty();
+			}
+
+			void work_on(const std::function<void(int)>& job, int count)
+			{
+				for (int i = next_.fetch_add(1); i < count; i = next_.fetch_add(1)) job(i);
+			}
+
+			void run_worker()
+			{
+				std::uint64_t seen;
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					seen = seen_;
+				}
+				while (true)
+				{
+					const std::function<void(int)> *job;
+					int count;
+					{
+						std::unique_lock<std::mutex> lock(mutex_);
+						cv_.wait(lock, [this, seen]{ return stop_ || generation_ != seen; });
+						if (stop_) return;
+						seen = generation_;
+						job = job_;
+						count = count_;
+					}
+					work_on(*job, count);
+					{
+						std::lock_guard<std::mutex> lock(mutex_);
+						if (--active_ == 0) doneCv_.notify_all();
+					}
+				}
+			}
+
+			std::mutex					runMutex_;
+			std::mutex					mutex_;
+			std::condition_variable		cv_;
+			std::condition_variable		doneCv_;
+			const std::function<void(int)>	*job_;
+			int							count_;
+			std::atomic<int>			next_;
+			int							active_;
+			std::uint64_t				generation_;
+			std::uint64_t				seen_;
+			bool						stop_;
+			std::vector<std::thread>	workers_;
+		};
+
+		/*!
+		 * \brief Resize src into dst, bands of output rows are resized independently.
+		 * Each band uses the full-image scale with a vertical shift, so result matches a single pass.
+		 */
+		template <typename _Tp> void resize_bands(const ImageBase<_Tp>& src, ImageBase<_Tp>& dst,
+			thirdparty::stbi::resize::stbir_datatype type, ResizeFilter filter, ResizeEdge edge, int threads)
+		{
+			using namespace thirdparty::stbi::resize;
+			static const stbir_filter kFilters[] = { STBIR_FILTER_DEFAULT, STBIR_FILTER_BOX, STBIR_FILTER_TRIANGLE,
+				STBIR_FILTER_CUBICBSPLINE, STBIR_FILTER_CATMULLROM, STBIR_FILTER_MITCHELL };
+			static const stbir_edge kEdges[] = { STBIR_EDGE_CLAMP, STBIR_EDGE_REFLECT, STBIR_EDGE_WRAP, STBIR_EDGE_ZERO };
+			stbir_filter f = kFilters[static_cast<int>(filter)];
+			stbir_edge e = kEdges[static_cast<int>(edge)];
+
+			BandRunner& runner = BandRunner::instance();
+			if (threads <= 0) threads = runner.concurrency();
+			int bands = (std::max)(1, (std::min)(threads, dst.rows() / consts::kResizeMinBandRows));
+			float xScale = static_cast<float>(dst.cols()) / src.cols();
+			float yScale = static_cast<float>(dst.rows()) / src.rows();
+			int srcStride = static_cast<int>(src.step() * sizeof(_Tp));
+			int dstStride = static_cast<int>(dst.step() * sizeof(_Tp));
+			int channels = src.channels();
+			runner.run(bands, [&](int band)
+			{
+				int r0 = static_cast<int>(static_cast<long long>(dst.rows()) * band / bands);
+				int r1 = static_cast<int>(static_cast<long long>(dst.rows()) * (band + 1) / bands);
+				stbir_resize_subpixel(src.ptr(0), src.cols(), src.rows(), srcStride,
+					dst.ptr(r0, 0, 0), dst.cols(), r1 - r0, dstStride, type, channels, STBIR_ALPHA_CHANNEL_NONE, 0,
+					e, e, f, f, STBIR_COLORSPACE_LINEAR, NULL, xScale, yScale, 0.f, static_cast<float>(r0));
+			});
+		}
+	} // namespace detail
+
+	void stop_resize_workers()
+	{
+		detail::BandRunner::instance().stop();
+	}
+
+	ImageAllocatorPtr ImageAllocator::default_allocator()
+	{
+		return std::atomic_load(&detail::default_image_allocator());
+	}
+
+	void ImageAllocator::set_default_allocator(ImageAllocatorPtr allocator)
+	{
+		if (!allocator) allocator = detail::aligned_image_allocator();
+		std::atomic_store(&detail::default_image_allocator(), allocator);
+	}
+
+	std::string ImageBufferPoolStats::to_string() const
+	{
+		std::uint64_t total = hits + misses;
+		std::uint64_t hitRate = total > 0 ? hits * 100 / total : 0;
+		return "hits: " + std::to_string(hits) + " misses: " + std::to_string(misses) + " hit rate: " + std::to_string(hitRate) + "%"
+			+ " recycled: " + std::to_string(recycled) + " evicted: " + std::to_string(evicted)
+			+ " cached: " + std::to_string(cachedBlocks) + " blocks/" + std::to_string(cachedBytes) + " bytes";
+	}
+
+	ImageBufferPool::ImageBufferPool(std::size_t maxCachedBytes, ImageAllocatorPtr upstream)
+		: upstream_(upstream ? upstream : detail::aligned_image_allocator()), maxCachedBytes_(maxCachedBytes)
+	{
+		stats_ = ImageBufferPoolStats();
+	}
+
+	ImageBufferPool::~ImageBufferPool()
+	{
+		trim();
+	}
+
+	void* ImageBufferPool::allocate(std::size_t size, std::size_t alignment)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			auto iter = buckets_.find(BucketKey(size, alignment));
+			if (iter != buckets_.end() && !iter->second.empty())
+			{
+				void *p = iter->second.back();
+				iter->second.pop_back();
+				--stats_.cachedBlocks;
+				stats_.cachedBytes -= size;
+				++stats_.hits;
+				return p;
+			}
+			++stats_.misses;
+		}
+		return upstream_->allocate(size, alignment);
+	}
+
+	void ImageBufferPool::deallocate(void* p, std::size_t size, std::size_t alignment)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (stats_.cachedBytes + size <= maxCachedBytes_)
+			{
+				buckets_[BucketKey(size, alignment)].push_back(p);
+				++stats_.cachedBlocks;
+				stats_.cachedBytes += size;
+				++stats_.recycled;
+				return;
+			}
+			++stats_.evicted;
+		}
+		upstream_->deallocate(p, size, alignment);
+	}
+
+	void ImageBufferPool::trim()
+	{
+		std::map<BucketKey, std::vector<void*>> idle;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			idle.swap(buckets_);
+			stats_.cachedBlocks = 0;
+			stats_.cachedBytes = 0;
+		}
+		for (auto& bucket : idle)
+		{
+			for (auto p : bucket.second)
+			{
+				upstream_->deallocate(p, bucket.first.first, bucket.first.second);
+			}
+		}
+	}
+
+	ImageBufferPoolStats ImageBufferPool::stats() const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return stats_;
+	}
+
+	void ImageBufferPool::reset_stats()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stats_.hits = 0;
+		stats_.misses = 0;
+		stats_.recycled = 0;
+		stats_.evicted = 0;
+	}
+
 	Image::Image(const char* filename)
 	{
 		load(filename);
@@ -13875,22 +16155,28 @@ namespace zz
 
 	void Image::save(const char* filename, int quality) const
 	{
+		if (!is_continuous())
+		{
+			// encoders expect packed rows
+			Image(clone()).save(filename, quality);
+			return;
+		}
 		std::string ext = fmt::to_lower_ascii(os::path_split_extension(filename));
 		if (ext == "jpg" || ext == "jpeg")
 		{
-			thirdparty::jo::jo_write_jpg(filename, (*data_).data(), cols_, rows_, channels_, quality);
+			thirdparty::jo::jo_write_jpg(filename, ptr(0), cols_, rows_, channels_, quality);
 		}
 		else if (ext == "png")
 		{
-			thirdparty::stbi::encode::stbi_write_png(filename, cols_, rows_, channels_, (*data_).data(), cols_ * channels_);
+			thirdparty::stbi::encode::stbi_write_png(filename, cols_, rows_, channels_, ptr(0), cols_ * channels_);
 		}
 		else if (ext == "bmp")
 		{
-			thirdparty::stbi::encode::stbi_write_bmp(filename, cols_, rows_, channels_, (*data_).data());
+			thirdparty::stbi::encode::stbi_write_bmp(filename, cols_, rows_, channels_, ptr(0));
 		}
 		else if (ext == "tga")
 		{
-			thirdparty::stbi::encode::stbi_write_tga(filename, cols_, rows_, channels_, (*data_).data());
+			thirdparty::stbi::encode::stbi_write_tga(filename, cols_, rows_, channels_, ptr(0));
 		}
 		else
 		{
@@ -13899,16 +16185,20 @@ namespace zz
 	}
 
 	void Image::resize(int width, int height)
+	{
+		resize(width, height, ResizeFilter::automatic);
+	}
+
+	void Image::resize(int width, int height, ResizeFilter filter, ResizeEdge edge, int threads)
 	{
 		assert(height > 0 && "height must > 0!");
 		assert(width > 0 && "width must > 0!");
 		range_check(0);
-		detach();
-		std::shared_ptr<std::vector<Image::value_type>> buf = std::make_shared<std::vector<Image::value_type>> (height * width * channels_);
-		thirdparty::stbi::resize::stbir_resize_uint8(&(*data_).front(), cols_, rows_, 0, &(*buf).front(), width, height, 0, channels_);
-		data_ = buf;
-		rows_ = height;
-		cols_ = width;
+		Image tmp;
+		tmp.set_allocator(allocator_);
+		tmp.create(height, width, channels_);
+		detail::resize_bands(*this, tmp, thirdparty::stbi::resize::STBIR_TYPE_UINT8, filter, edge, threads);
+		*this = tmp;
 	}
 
 	void Image::resize(double ratio)
@@ -13916,12 +16206,12 @@ namespace zz
 		assert(ratio > 0 && "resize ratio must > 0!");
 		int width = static_cast<int>(cols_ * ratio);
 		int height = static_cast<int>(rows_ * ratio);
-		resize(height, width);
+		resize(width, height);
 	}
 
 	void Image::resize(Size sz)
 	{
-		resize(sz.height, sz.width);
+		resize(sz.width, sz.height);
 	}
 
 	ImageHdr::ImageHdr(const char* filename)
@@ -13953,17 +16243,29 @@ namespace zz
 
 	void ImageHdr::save_hdr(const char* filename) const
 	{
-		thirdparty::stbi::encode::stbi_write_hdr(filename, cols_, rows_, channels_, (*data_).data());
+		if (!is_continuous())
+		{
+			// encoders expect packed rows
+			ImageHdr(clone()).save_hdr(filename);
+			return;
+		}
+		thirdparty::stbi::encode::stbi_write_hdr(filename, cols_, rows_, channels_, ptr(0));
 	}
 
 	Image ImageHdr::to_normal(float range) const
 	{
-		Image tmp(rows_, cols_, channels_);
+		Image tmp;
+		tmp.set_allocator(allocator_);
+		tmp.create(rows_, cols_, channels_);
 		auto p = tmp.ptr();
-		for (auto iter = (*data_).cbegin(); iter != (*data_).cend(); ++iter)
+		for (int r = 0; r < rows_; ++r)
 		{
-			*p = saturate_cast<Image::value_type>(*iter / range * 255);
-			++p;
+			const ImageHdr::value_type *row = ptr(r, 0, 0);
+			for (int i = 0; i < cols_ * channels_; ++i)
+			{
+				*p = saturate_cast<Image::value_type>(row[i] / range * 255);
+				++p;
+			}
 		}
 		return tmp;
 	}
@@ -13971,25 +16273,33 @@ namespace zz
 	void ImageHdr::from_normal(const Image& from, float range)
 	{
 		create(from.rows(), from.cols(), from.channels());
-		auto p = from.ptr();
-		for (auto iter = (*data_).begin(); iter != (*data_).end(); ++iter)
+		auto iter = data_.get();
+		for (int r = 0; r < rows_; ++r)
 		{
-			*iter = saturate_cast<value_type>(*p / 255.0f * range);
-			++p;
+			const Image::value_type *p = from.ptr(r, 0, 0);
+			for (int i = 0; i < cols_ * channels_; ++i)
+			{
+				*iter = saturate_cast<value_type>(p[i] / 255.0f * range);
+				++iter;
+			}
 		}
 	}
 
 	void ImageHdr::resize(int width, int height)
+	{
+		resize(width, height, ResizeFilter::automatic);
+	}
+
+	void ImageHdr::resize(int width, int height, ResizeFilter filter, ResizeEdge edge, int threads)
 	{
 		assert(height > 0 && "height must > 0!");
 		assert(width > 0 && "width must > 0!");
 		range_check(0);
-		detach();
-		std::shared_ptr<std::vector<ImageHdr::value_type>> buf = std::make_shared<std::vector<ImageHdr::value_type>>(height * width * channels_);
-		thirdparty::stbi::resize::stbir_resize_float(&(*data_).front(), cols_, rows_, 0, &(*buf).front(), width, height, 0, channels_);
-		data_ = buf;
-		rows_ = height;
-		cols_ = width;
+		ImageHdr tmp;
+		tmp.set_allocator(allocator_);
+		tmp.create(height, width, channels_);
+		detail::resize_bands(*this, tmp, thirdparty::stbi::resize::STBIR_TYPE_FLOAT, filter, edge, threads);
+		*this = tmp;
 	}
 
 	void ImageHdr::resize(double ratio)
@@ -13997,12 +16307,12 @@ namespace zz
 		assert(ratio > 0 && "resize ratio must > 0!");
 		int width = static_cast<int>(cols_ * ratio);
 		int height = static_cast<int>(rows_ * ratio);
-		resize(height, width);
+		resize(width, height);
 	}
 
 	void ImageHdr::resize(Size sz)
 	{
-		resize(sz.height, sz.width);
+		resize(sz.width, sz.height);
 	}
 
 } // end namesapce zz
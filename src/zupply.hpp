@@ -81,6 +81,8 @@
 #include <ctime>
 #include <chrono>
 #include <thread>
+#include <condition_variable>
+#include <deque>
 #include <mutex>
 #include <atomic>
 #include <map>
@@ -92,6 +94,7 @@
 #include <algorithm>
 #include <functional>
 #include <climits>
+#include <cstdint>
 #include <cassert>
 #include <cstring>
 #include <cmath>
@@ -548,16 +551,171 @@ namespace zz
 	 */
 	typedef Rect2i Rect;
 
+	namespace consts
+	{
+		static const std::size_t kImageAlignment = 64;	//!< byte alignment of image storage, covers AVX-512 loads and cache lines
+		static const std::size_t kImageBufferPoolMaxBytes = 268435456;	//!< default cap of idle bytes kept by ImageBufferPool
+		static const int kResizeMinBandRows = 32;	//!< output rows per band at least when resize is split across threads
+	}
+
+	/*!
+	 * \brief The ImageAllocator class.
+	 * Interface of raw image storage. Implement it to feed images from a memory pool
+	 * or pre-allocated frames instead of going to malloc on every create().
+	 */
+	class ImageAllocator
+	{
+	public:
+		virtual ~ImageAllocator() {};
+
+		/*!
+		 * \brief allocate Get a block of memory, throw MemException if failed
+		 * \param size Size in bytes, always a multiple of alignment
+		 * \param alignment Byte alignment required, power of 2
+		 * \return Pointer to the block
+		 */
+		virtual void* allocate(std::size_t size, std::size_t alignment) = 0;
+
+		/*!
+		 * \brief deallocate Give back a block returned by allocate()
+		 * \param p
+		 * \param size Same size passed to allocate()
+		 * \param alignment Same alignment passed to allocate()
+		 */
+		virtual void deallocate(void* p, std::size_t size, std::size_t alignment) = 0;
+
+		/*!
+		 * \brief default_allocator Get the allocator used by images without one set.
+		 * This is the aligned heap allocator unless replaced by set_default_allocator().
+		 * \return Default allocator
+		 */
+		static std::shared_ptr<ImageAllocator> default_allocator();
+
+		/*!
+		 * \brief set_default_allocator Replace the allocator used by images without one set, e.g. with an ImageBufferPool.
+		 * Storage already allocated is returned to the allocator it came from.
+		 * \param allocator Null restores the aligned heap allocator
+		 */
+		static void set_default_allocator(std::shared_ptr<ImageAllocator> allocator);
+	};
+
+	typedef std::shared_ptr<ImageAllocator> ImageAllocatorPtr;
+
+	/*!
+	 * \brief Snapshot of ImageBufferPool counters
+	 */
+	struct ImageBufferPoolStats
+	{
+		std::uint64_t	hits;		//!< allocations served from cached blocks
+		std::uint64_t	misses;		//!< allocations passed to the upstream allocator
+		std::uint64_t	recycled;	//!< blocks kept for reuse on deallocation
+		std::uint64_t	evicted;	//!< blocks freed because the pool was full
+		std::size_t		cachedBlocks;	//!< idle blocks currently held
+		std::size_t		cachedBytes;	//!< idle bytes currently held
+
+		/*!
+		 * \brief Get user friendly summary
+		 * \return Summary string
+		 */
+		std::string to_string() const;
+	};
+
+	/*!
+	 * \brief The ImageBufferPool class.
+	 * Thread-safe allocator that keeps released image storage in buckets of identical size and alignment,
+	 * so same-size frames recycle blocks instead of going to the heap.
+	 * Images give blocks back automatically when the last copy of the storage is destroyed.
+	 * \example auto pool = std::make_shared<ImageBufferPool>(); img.set_allocator(pool);
+	 * or ImageAllocator::set_default_allocator(pool) to pool every image.
+	 */
+	class ImageBufferPool : public ImageAllocator, private UnMovable
+	{
+	public:
+		/*!
+		 * \brief ImageBufferPool constructor
+		 * \param maxCachedBytes Idle bytes to keep at most, larger releases go back to upstream
+		 * \param upstream Allocator for pool misses, null to use the aligned heap allocator
+		 */
+		explicit ImageBufferPool(std::size_t maxCachedBytes = consts::kImageBufferPoolMaxBytes, ImageAllocatorPtr upstream = nullptr);
+
+		~ImageBufferPool();
+
+		void* allocate(std::size_t size, std::size_t alignment) override;
+
+		void deallocate(void* p, std::size_t size, std::size_t alignment) override;
+
+		/*!
+		 * \brief trim Free all idle blocks to upstream
+		 */
+		void trim();
+
+		/*!
+		 * \brief stats Get counters
+		 * \return Snapshot of counters
+		 */
+		ImageBufferPoolStats stats() const;
+
+		/*!
+		 * \brief reset_stats Reset hit/miss counters, cached sizes are kept
+		 */
+		void reset_stats();
+
+	private:
+		typedef std::pair<std::size_t, std::size_t> BucketKey;	// size, alignment
+
+		mutable std::mutex			mutex_;
+		std::map<BucketKey, std::vector<void*>>	buckets_;
+		ImageAllocatorPtr			upstream_;
+		std::size_t					maxCachedBytes_;
+		ImageBufferPoolStats		stats_;
+	};
+
+	/*!
+	 * \brief Resampling filter used by image resize.
+	 */
+	enum class ResizeFilter
+	{
+		automatic,		//!< catmull-rom for upsampling, mitchell for downsampling
+		box,			//!< trapezoid with 1-pixel wide ramps, same as box for integer ratios
+		triangle,		//!< bilinear on upsampling
+		cubic_bspline,	//!< gaussian-esque cubic b-spline
+		catmull_rom,	//!< interpolating cubic spline
+		mitchell		//!< mitchell-netravali with B=1/3, C=1/3
+	};
+
+	/*!
+	 * \brief How image resize samples outside of the source edges.
+	 */
+	enum class ResizeEdge
+	{
+		clamp,		//!< repeat the edge pixels
+		reflect,	//!< mirror the image at the edges
+		wrap,		//!< tile the image
+		zero		//!< treat outside pixels as zero
+	};
+
+	/*!
+	 * \brief Stop and join the worker threads used by parallel image resize.
+	 * Workers are started again by the next parallel resize.
+	 * Call it before exit with VC12, where joining threads in static destructors deadlocks.
+	 */
+	void stop_resize_workers();
+
 	namespace detail
 	{
 		/*!
 		 * \brief Base image storage class
 		 * This defines the storage and pixel-wise access to a image like 3-D matrix
+		 * Copies share storage. Only the mutable () operator triggers copy-on-write,
+		 * pixel(), row_ptr(), row_begin(), row_end() and ptr() write through to the shared storage,
+		 * call ensure_unique() once before writing through them.
 		 */
 		template<typename _Tp> class ImageBase
 		{
 		public:
 			typedef _Tp value_type;
+			typedef _Tp* row_iterator;
+			typedef const _Tp* const_row_iterator;
 
 			/*!
 			 * \brief ImageBase Default(empty) constructor
@@ -589,12 +747,28 @@ namespace zz
 			virtual ~ImageBase();
 
 			/*!
-			 * \brief create Create storage with specified size
+			 * \brief create Create storage with specified size.
+			 * Storage starts at kImageAlignment bytes boundary and is zero initialized.
 			 * \param rows
 			 * \param cols
 			 * \param channels
+			 * \param rowAlign Byte alignment of every row start, power of 2. 0 keeps rows packed.
+			 * Padded rows make the image non-continuous, step() reports the padded stride.
+			 */
+			void create(int rows, int cols, int channels, int rowAlign = 0);
+
+			/*!
+			 * \brief set_allocator Set allocator used by following create(), clone() and copy-on-write.
+			 * Existing storage is kept until released. Null restores the default allocator.
+			 * \param allocator
+			 */
+			void set_allocator(ImageAllocatorPtr allocator);
+
+			/*!
+			 * \brief allocator Get allocator set by set_allocator()
+			 * \return Allocator, null if default one is used
 			 */
-			void create(int rows, int cols, int channels);
+			ImageAllocatorPtr allocator() const;
 
 			/*!
 			 * \brief release Destroy memory storage
@@ -617,6 +791,8 @@ namespace zz
 
 			/*!
 			 * \brief operator () Access pixel element
+			 * Triggers copy-on-write if storage is shared, bounds are checked in debug build only.
+			 * For tight loops call ensure_unique() once and use pixel() or row pointers instead.
 			 * \param row
 			 * \param col
 			 * \param channel
@@ -626,6 +802,7 @@ namespace zz
 
 			/*!
 			 * \brief operator () Access pixel element, immutable version
+			 * Never copies, bounds are checked in debug build only.
 			 * \param row
 			 * \param col
 			 * \param channel
@@ -672,6 +849,76 @@ namespace zz
 			 */
 			_Tp at(int row, int col, int channel = 0) const;
 
+			/*!
+			 * \brief pixel Unchecked pixel access, writes through shared storage.
+			 * Bounds are asserted in debug build only.
+			 * \param row
+			 * \param col
+			 * \param channel
+			 * \return Reference to pixel element
+			 */
+			_Tp& pixel(int row, int col, int channel = 0);
+
+			/*!
+			 * \brief pixel Unchecked pixel access, immutable version
+			 * \param row
+			 * \param col
+			 * \param channel
+			 * \return Reference to pixel element
+			 */
+			const _Tp& pixel(int row, int col, int channel = 0) const;
+
+			/*!
+			 * \brief ensure_unique Detach from shared storage so that following writes
+			 * through pixel() or row pointers won't affect other copies.
+			 * Call once per mutable-access scope instead of paying copy-on-write per element.
+			 */
+			void ensure_unique();
+
+			/*!
+			 * \brief row_ptr Pointer to the first element of a row.
+			 * Mutable version, unchecked and writes through shared storage like pixel().
+			 * Elements of a row are contiguous, cols * channels in total.
+			 * \param row
+			 * \return Row pointer
+			 */
+			_Tp* row_ptr(int row);
+
+			/*!
+			 * \brief row_ptr Pointer to the first element of a row, immutable version
+			 * \param row
+			 * \return Row pointer
+			 */
+			const _Tp* row_ptr(int row) const;
+
+			/*!
+			 * \brief row_begin Iterator to the first element of a row, writes through shared storage like pixel()
+			 * \param row
+			 * \return Row iterator
+			 */
+			row_iterator row_begin(int row);
+
+			/*!
+			 * \brief row_end Iterator past the last element of a row
+			 * \param row
+			 * \return Row iterator
+			 */
+			row_iterator row_end(int row);
+
+			/*!
+			 * \brief row_begin Iterator to the first element of a row, immutable version
+			 * \param row
+			 * \return Row iterator
+			 */
+			const_row_iterator row_begin(int row) const;
+
+			/*!
+			 * \brief row_end Iterator past the last element of a row, immutable version
+			 * \param row
+			 * \return Row iterator
+			 */
+			const_row_iterator row_end(int row) const;
+
 			/*!
 			 * \brief ptr Data pointer given specifed position.
 			 * Use with cautious. This is provided for performance consideration.
@@ -724,8 +971,48 @@ namespace zz
 			 */
 			template <typename _Tp2> std::vector<_Tp2>& export_raw(std::vector<_Tp2>& out) const;
 
+			/*!
+			 * \brief step Number of elements between the starts of two adjacent rows.
+			 * Equals cols * channels unless this image is a view into a larger one.
+			 * \return Row step in elements
+			 */
+			int step() const;
+
+			/*!
+			 * \brief is_continuous Check if rows are stored back to back without gaps.
+			 * \return True if the whole image is one contiguous block
+			 */
+			bool is_continuous() const;
+
+			/*!
+			 * \brief roi Get a view of a rectangle region, the view shares memory with this image.
+			 * No pixel is copied, the view keeps the underlying storage alive.
+			 * Like copies, writing through () operator will detach a shared view, while ptr() writes through.
+			 * Throws RuntimeException if a point is outside of the image or the region is empty.
+			 * \param r0
+			 * \param c0
+			 * \param r1
+			 * \param c1
+			 * \return Strided view of rows [r0, r1) and columns [c0, c1)
+			 */
+			ImageBase roi(int r0, int c0, int r1, int c1) const;
+
+			/*!
+			 * \brief roi Get a view of a rectangle region, the view shares memory with this image.
+			 * \param rect
+			 * \return Strided view of the region
+			 */
+			ImageBase roi(Rect rect) const;
+
+			/*!
+			 * \brief clone Deep copy into a new contiguous image, materializes views.
+			 * \return Image that owns its own storage
+			 */
+			ImageBase clone() const;
+
 			/*!
 			 * \brief crop Crop image given coordinates.
+			 * This is zero-copy, the cropped image is a view into the original storage.
 			 * \param r0
 			 * \param c0
 			 * \param r1
@@ -754,7 +1041,10 @@ namespace zz
 			int rows_;
 			int cols_;
 			int channels_;
-			std::shared_ptr<std::vector<_Tp>> data_;
+			long offset_;
+			int step_;
+			std::shared_ptr<_Tp> data_;
+			ImageAllocatorPtr allocator_;
 
 		};
 	} // namespace zz::detail
@@ -780,6 +1070,12 @@ namespace zz
 		 */
 		Image(int rows, int cols, int channels) : ImageBase(rows, cols, channels) {};
 
+		/*!
+		 * \brief Image Construct from base storage, e.g. a view from roi() or clone()
+		 * \param base
+		 */
+		Image(const detail::ImageBase<unsigned char>& base) : ImageBase(base) {};
+
 		/*!
 		 * \brief Image Constructor from disk image file.
 		 * \param filename
@@ -806,12 +1102,23 @@ namespace zz
 		void resize(Size sz);
 
 		/*!
-		* \brief resize Resize image given new height and width
-		* \param height
+		* \brief resize Resize image given new width and height.
+		* Large images are split into bands of output rows resized in parallel.
 		* \param width
+		* \param height
 		*/
 		void resize(int width, int height);
 
+		/*!
+		* \brief resize Resize image given new width and height with specified filter and edge mode
+		* \param width
+		* \param height
+		* \param filter
+		* \param edge
+		* \param threads Max threads to use, 0 to use all cores, 1 to resize in the calling thread only
+		*/
+		void resize(int width, int height, ResizeFilter filter, ResizeEdge edge = ResizeEdge::clamp, int threads = 0);
+
 		/*!
 		* \brief resize Resize image given ratio to the old size
 		* \param ratio
@@ -839,6 +1146,12 @@ namespace zz
 		 */
 		ImageHdr(int rows, int cols, int channels) : ImageBase(rows, cols, channels) {};
 
+		/*!
+		 * \brief ImageHdr Construct from base storage, e.g. a view from roi() or clone()
+		 * \param base
+		 */
+		ImageHdr(const detail::ImageBase<float>& base) : ImageBase(base) {};
+
 		/*!
 		 * \brief ImageHdr Constructor from disk image file
 		 * \param filename
@@ -885,12 +1198,23 @@ namespace zz
 		void resize(Size sz);
 
 		/*!
-		* \brief resize Resize image given new height and width
-		* \param height
+		* \brief resize Resize image given new width and height.
+		* Large images are split into bands of output rows resized in parallel.
 		* \param width
+		* \param height
 		*/
 		void resize(int width, int height);
 
+		/*!
+		* \brief resize Resize image given new width and height with specified filter and edge mode
+		* \param width
+		* \param height
+		* \param filter
+		* \param edge
+		* \param threads Max threads to use, 0 to use all cores, 1 to resize in the calling thread only
+		*/
+		void resize(int width, int height, ResizeFilter filter, ResizeEdge edge = ResizeEdge::clamp, int threads = 0);
+
 		/*!
 		* \brief resize Resize image given ratio to the old size
 		* \param ratio
@@ -1455,42 +1779,71 @@ namespace zz
 		//	std::shared_ptr<MapType>	mapPtr_;
 		//};
 
-		///*!
-		// * \brief AtomicNonTrivial Template lock-free class
-		// * AtomicNonTrivial is lock-free, however, modification will create copies.
-		// * Thus this structure is good for read-many write-rare purposes.
-		// */
-		//template <typename T> class AtomicNonTrivial
-		//{
-		//public:
-		//	AtomicNonTrivial()
-		//	{
-		//		ptr_ = std::make_shared<T>();
-		//	}
+		/*!
+		 * \brief AtomicNonTrivial Template lock-free class
+		 * AtomicNonTrivial is lock-free for readers, however, modification will create copies.
+		 * Thus this structure is good for read-many write-rare purposes.
+		 */
+		template <typename T> class AtomicNonTrivial : public UnMovable
+		{
+		public:
+			AtomicNonTrivial()
+			{
+				ptr_ = std::make_shared<const T>();
+			}
 
-		//	/*!
-		//	 * \brief Get shared_ptr to instance
-		//	 * \return Shared_ptr to instance
-		//	 */
-		//	std::shared_ptr<T> get()
-		//	{
-		//		return std::atomic_load(&ptr_);
-		//	}
+			/*!
+			 * \brief Get shared_ptr to immutable instance
+			 * \return Shared_ptr to instance
+			 */
+			std::shared_ptr<const T> get() const
+			{
+				return std::atomic_load(&ptr_);
+			}
 
-		//	/*!
-		//	 * \brief Set to new value
-		//	 * \param val
-		//	 * This operation will make a copy which is only visible for future get()
-		//	 */
-		//	void set(const T& val)
-		//	{
-		//		std::shared_ptr<T> copy = std::make_shared<T>(val);
-		//		std::atomic_store(&ptr_, copy);
-		//	}
+			/*!
+			 * \brief Set to new value
+			 * \param val
+			 * This operation will make a copy which is only visible for future get()
+			 */
+			void set(const T& val)
+			{
+				std::shared_ptr<const T> copy = std::make_shared<const T>(val);
+				std::atomic_store(&ptr_, copy);
+			}
 
-		//private:
-		//	std::shared_ptr<T>	ptr_;
-		//};
+			/*!
+			 * \brief Set to existing immutable instance, no copy
+			 * \param ptr
+			 */
+			void set(std::shared_ptr<const T> ptr)
+			{
+				std::atomic_store(&ptr_, ptr);
+			}
+
+			/*!
+			 * \brief Modify value in copy-and-swap manner.
+			 * Functor is applied to a copy of current value, and the copy is published
+			 * only if no other writer modified the value in the meantime, otherwise retry.
+			 * \param func Functor bool(T&), return false to abort modification
+			 * \return True if modification is published
+			 */
+			template <typename Func> bool modify(Func func)
+			{
+				std::shared_ptr<const T> p = std::atomic_load(&ptr_);
+				std::shared_ptr<const T> copy;
+				do
+				{
+					std::shared_ptr<T> tmp = std::make_shared<T>(*p);
+					if (!func(*tmp)) return false;
+					copy = tmp;
+				} while (!std::atomic_compare_exchange_weak(&ptr_, &p, copy));
+				return true;
+			}
+
+		private:
+			std::shared_ptr<const T>	ptr_;
+		};
 
 
 		//		namespace gc
@@ -1635,11 +1988,33 @@ namespace zz
 
 		/*!
 		 * \fn std::size_t thread_id()
-		 * \brief Get thread id
+		 * \brief Get thread id, queried once and cached per thread
 		 * \return Current thread id
 		 */
 		std::size_t thread_id();
 
+		/*!
+		 * \fn void set_thread_name(std::string name)
+		 * \brief Assign a human readable name to the calling thread, printed by log sinks instead of thread id.
+		 * Also set as OS thread name where supported(truncated to 15 characters on linux).
+		 * \param name Thread name, empty to reset
+		 */
+		void set_thread_name(std::string name);
+
+		/*!
+		 * \fn const std::string& thread_name()
+		 * \brief Get name of the calling thread
+		 * \return Thread name, empty if not assigned. Reference stays valid for program lifetime.
+		 */
+		const std::string& thread_name();
+
+		/*!
+		 * \fn bool lower_thread_priority()
+		 * \brief Lower scheduling priority of the calling thread, for background jobs
+		 * \return True on success
+		 */
+		bool lower_thread_priority();
+
 		/*!
 		 * \brief Check if stdout is associated with console
 		 * \return None zero value if stdout is not redirected to file
@@ -2295,6 +2670,13 @@ namespace zz
 			template <typename T>
 			FileEditor& operator<<(T what) { stream_ << what; return *this; }
 
+			/*!
+			 * \brief Write raw data in one call
+			 * \param data
+			 * \param size Size in byte
+			 */
+			void write(const char *data, std::size_t size) { stream_.write(data, size); }
+
 			/*!
 			 * \brief Return filename
 			 * \return Filename of this object
@@ -2461,6 +2843,56 @@ namespace zz
 		 */
 		std::size_t get_file_size(std::string filename);
 
+		/*!
+		 * \brief The MemoryMappedFile class, map a file of fixed size into memory for read/write.
+		 * File is created if not exist, and resized to the requested size.
+		 * Pages are written back by the OS, even if the process crashes.
+		 */
+		class MemoryMappedFile : private UnMovable
+		{
+		public:
+			/*!
+			 * \brief MemoryMappedFile constructor, throw RuntimeException if failed
+			 * \param filename
+			 * \param size Size of mapped region in byte
+			 */
+			MemoryMappedFile(std::string filename, std::size_t size);
+
+			~MemoryMappedFile() { close(); }
+
+			/*!
+			 * \brief Return filename
+			 * \return Filename of this object
+			 */
+			std::string filename() const { return filename_; }
+
+			/*!
+			 * \brief Get pointer to mapped memory
+			 * \return Pointer to the beginning of mapped region
+			 */
+			char* data() { return data_; }
+
+			/*!
+			 * \brief Get size of mapped region
+			 * \return Size in byte
+			 */
+			std::size_t size() const { return size_; }
+
+			/*!
+			 * \brief Schedule write back of dirty pages, do not wait for completion
+			 */
+			void flush();
+
+		private:
+			void close();
+
+			std::string		filename_;
+			std::size_t		size_;
+			char			*data_;
+			std::intptr_t	file_;		//!< file descriptor or handle
+			void			*mapping_;	//!< mapping handle, windows only
+		};
+
 	} //namespace fs
 
 
@@ -3457,6 +3889,27 @@ namespace zz
 			sentinel = 63
 		}LogLevels;
 
+		/*!
+		 * \brief Behavior of async sink when its queue is full.
+		 */
+		enum class OverflowPolicy
+		{
+			block,				//!< wait with backoff until queue has room
+			drop_newest,		//!< discard the incoming message
+			drop_oldest,		//!< discard the oldest queued message to make room
+			drop_below_level	//!< discard incoming messages below a level, block for the others
+		};
+
+		/*!
+		 * \brief Time based rotation of rotate file sink, at local time boundaries.
+		 */
+		enum class RotateInterval
+		{
+			none,		//!< rotate by size only
+			hourly,		//!< rotate at the beginning of every hour
+			daily		//!< rotate at midnight
+		};
+
 		namespace consts
 		{
 			static const char	*kLevelNames[] { "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL", "OFF"};
@@ -3470,11 +3923,36 @@ namespace zz
 			static const char	*kSinkLevelSpecifier = "%level";
 			static const char	*kSinkLevelShortSpecifier = "%lvl";
 			static const char	*kSinkMessageSpecifier = "%msg";
+			static const char	*kSinkFieldsSpecifier = "%fields";	//!< key-value fields as key=value pairs
+			static const char	*kSinkJsonSpecifier = "%json";	//!< whole message as one json object, fields nested under "fields"
 			static const char	*kStdoutSinkName = "stdout";
 			static const char	*kStderrSinkName = "stderr";
 			static const char	*kSimplefileSinkType = "simplefile";
 			static const char	*kRotatefileSinkType = "rotatefile";
 			static const char	*kOstreamSinkType = "ostream";
+			static const char	*kAsyncSinkType = "async";
+			static const char	*kAsyncSinkNamePrefix = "async:";
+			static const char	*kBinaryfileSinkType = "binaryfile";
+			static const char	*kBinaryLogMagic = "ZZBL";
+			static const int	kBinaryLogVersion = 1;
+			static const char	*kRingfileSinkType = "ringfile";
+			static const char	*kRingLogMagic = "ZZRING1";
+			static const std::size_t kRingLogHeaderSize = 64;
+			static const std::size_t kRingLogDefaultCapacity = 4194304;
+			static const char	*kNullSinkType = "null";
+			static const char	*kMemorySinkType = "memory";
+			static const std::size_t kMemorySinkCapacity = 1024;	//!< lines kept by memory sink
+			static const std::size_t kMemorySinkLineSize = 512;	//!< longer lines are truncated in memory sink
+			static const std::size_t kRotateFileMaxSize = 4194304;
+			static const std::size_t kFileSinkBufferSize = 65536;	//!< suggested buffer size, file sinks are unbuffered by default
+			static const int	kFileSinkFlushInterval = 1000;
+			static const int	kAsyncWorkerSpinCount = 64;	//!< yields before async worker starts sleeping
+			static const int	kAsyncWorkerSleepInterval = 1;	//!< async worker sleep interval in ms when idle
+			static const int	kAsyncDropReportInterval = 5000;	//!< interval in ms to report dropped messages
+			static const char	*kSuppressedMessageFormat = "suppressed {} similar messages";
+			static const int	kLatencySubBucketBits = 4;	//!< 16 linear sub-buckets per power of 2, 1/16 relative error
+			static const int	kLatencyBucketCount = (64 - kLatencySubBucketBits + 1) << kLatencySubBucketBits;
+			static const char	*kOverflowPolicyNames[] { "block", "drop_newest", "drop_oldest", "drop_below_level" };
 			static const char	*kDefaultLoggerFormat = "[%datetime][T%thread][%logger][%level] %msg";
 			static const char	*kDefaultLoggerDatetimeFormat = "%y-%m-%d %H:%M:%S.%frac";
 
@@ -3488,6 +3966,25 @@ namespace zz
 			static const char	*kConfigSinkListSpecifier = "sink_list";
 			static const char	*kConfigSinkTypeSpecifier = "type";
 			static const char	*kConfigSinkFilenameSpecifier = "filename";
+			static const char	*kConfigSinkBackendSpecifier = "backend";
+			static const char	*kConfigSinkQueueSizeSpecifier = "queue_size";
+			static const char	*kConfigSinkOverflowSpecifier = "overflow";
+			static const char	*kConfigSinkOverflowLevelSpecifier = "overflow_level";
+			static const char	*kConfigSinkCapacitySpecifier = "capacity";
+			static const char	*kConfigSinkBufferSizeSpecifier = "buffer_size";
+			static const char	*kConfigSinkFlushIntervalSpecifier = "flush_interval";
+			static const char	*kConfigSinkMaxSizeSpecifier = "max_size";
+			static const char	*kConfigSinkBackupSpecifier = "backup";
+			static const char	*kConfigSinkRotateIntervalSpecifier = "rotate_interval";
+			static const char	*kConfigSinkMaxBackupsSpecifier = "max_backups";
+			static const char	*kConfigSinkCompressSpecifier = "compress";
+			static const char	*kConfigSinkLineSizeSpecifier = "line_size";
+			static const char	*kRotateIntervalNames[] { "none", "hourly", "daily" };
+			static const char	*kRotateBackupSuffix = "_%y-%m-%d_%H-%M-%S-%frac";
+			static const std::size_t kRotateBackupSuffixLength = 21;
+			static const char	*kRotateNextFileSuffix = ".next";
+			static const char	*kRotateCompressSuffix = ".gz";
+			static const std::size_t kRotateCompressQueueSize = 16;	//!< pending compressions, backups beyond are left uncompressed
 		}
 
 		// forward declaration
@@ -3510,6 +4007,10 @@ namespace zz
 
 		int level_mask_from_string(std::string levels);
 
+		OverflowPolicy overflow_policy_from_str(std::string policy);
+
+		RotateInterval rotate_interval_from_str(std::string interval);
+
 		// \endcond
 
 		/*!
@@ -3600,13 +4101,157 @@ namespace zz
 			 */
 			void set_datetime_format(std::string newDatetimeFormat);
 
-		private:
-			LogConfig();
+			/*!
+			 * \brief Get default datetime format without copying the string
+			 * \return Shared pointer to immutable datetime format
+			 */
+			std::shared_ptr<const std::string> datetime_format_ptr();
 
-			cds::lockbased::NonTrivialContainer<std::vector<std::string>> sinkList_;
+			/*!
+			 * \brief Check if latency of loggers and sinks is measured, disabled by default
+			 * \return True if enabled
+			 */
+			bool latency_stats() const
+			{
+				return latencyStats_.load(std::memory_order_relaxed);
+			}
+
+			/*!
+			 * \brief Enable or disable latency measurement of loggers and sinks.
+			 * Counters are always updated, latency costs two clock reads per logger and sink call.
+			 * \param enable
+			 */
+			void set_latency_stats(bool enable)
+			{
+				latencyStats_ = enable;
+			}
+
+		private:
+			LogConfig();
+
+			cds::lockbased::NonTrivialContainer<std::vector<std::string>> sinkList_;
 			std::atomic_int logLevelMask_;
 			cds::lockbased::NonTrivialContainer<std::string> format_;
-			cds::lockbased::NonTrivialContainer<std::string> datetimeFormat_;
+			cds::AtomicNonTrivial<std::string> datetimeFormat_;
+			std::atomic_bool latencyStats_;
+		};
+
+		/*!
+		 * \brief Lock-free latency histogram in nanoseconds.
+		 * Buckets are powers of 2 split into linear sub-buckets(HDR histogram style),
+		 * so any recorded value is kept within 1/16 relative error.
+		 */
+		class LatencyHistogram : private UnMovable
+		{
+		public:
+			LatencyHistogram() { reset(); }
+
+			/*!
+			 * \brief Record one value
+			 * \param ns Latency in nanoseconds
+			 */
+			void record(std::uint64_t ns);
+
+			/*!
+			 * \brief Get number of recorded values
+			 * \return Count
+			 */
+			std::uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+			/*!
+			 * \brief Get maximum recorded value
+			 * \return Maximum in ns
+			 */
+			std::uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+			/*!
+			 * \brief Get mean of recorded values
+			 * \return Mean in ns, 0 if empty
+			 */
+			double mean() const;
+
+			/*!
+			 * \brief Get value at percentile
+			 * \param percent Percentile in range [0, 100]
+			 * \return Upper bound of the bucket in ns, 0 if empty
+			 */
+			std::uint64_t percentile(double percent) const;
+
+			/*!
+			 * \brief Add values recorded by another histogram, e.g. per thread histograms
+			 * \param other
+			 */
+			void merge(const LatencyHistogram &other);
+
+			/*!
+			 * \brief Clear all recorded values
+			 */
+			void reset();
+
+			/*!
+			 * \brief Get summary, e.g. count, mean, p50, p99, max
+			 * \return Summary string
+			 */
+			std::string to_string() const;
+
+		private:
+			std::atomic<std::uint64_t>	buckets_[consts::kLatencyBucketCount];
+			std::atomic<std::uint64_t>	count_;
+			std::atomic<std::uint64_t>	sum_;
+			std::atomic<std::uint64_t>	max_;
+		};
+
+		/*!
+		 * \brief Counters and latency of a logger or sink, updated with relaxed atomics.
+		 * For loggers, latency covers dispatching to all sinks, for sinks, the actual write.
+		 */
+		struct LogStats : private UnMovable
+		{
+			LogStats() { reset(); }
+
+			std::atomic<std::uint64_t>	accepted_;	//!< messages passed level filter
+			std::atomic<std::uint64_t>	filtered_;	//!< messages rejected by level mask or rate limit
+			std::atomic<std::uint64_t>	dropped_;	//!< messages lost, e.g. async queue overflow
+			std::atomic<std::uint64_t>	bytes_;		//!< bytes written by sink
+			LatencyHistogram			latency_;
+
+			/*!
+			 * \brief Reset all counters and latency
+			 */
+			void reset();
+
+			/*!
+			 * \brief Get user friendly summary
+			 * \return Summary string
+			 */
+			std::string to_string() const;
+		};
+
+		/*!
+		 * \brief Lock-free state of a rate limited call site, usually a static owned by the call site.
+		 * ZZ_LOG_EVERY_N, ZZ_LOG_EVERY and ZZ_LOG_FIRST_N create one per macro expansion,
+		 * which is the preferred way to use rate limited logging.
+		 * Calling Logger::info_every_n() and the like directly requires one LogSite per call site,
+		 * e.g. static log::LogSite site; logger->info_every_n(site, 100, "value {}", v);
+		 * Sharing a LogSite between call sites makes them count together.
+		 * Each decision returns true if the message should be logged, and then
+		 * the number of messages suppressed since the previous logged one.
+		 */
+		class LogSite
+		{
+		public:
+			constexpr LogSite() : count_(0), next_(0), suppressed_(0) {}
+
+			bool every_n(std::uint64_t n, std::uint64_t &suppressed);
+			bool every(std::int64_t intervalNs, std::uint64_t &suppressed);
+			bool first_n(std::uint64_t n, std::uint64_t thenEveryN, std::uint64_t &suppressed);
+
+		private:
+			bool pass(bool logged, std::uint64_t &suppressed);
+
+			std::atomic<std::uint64_t>	count_;
+			std::atomic<std::int64_t>	next_;		//!< steady clock time in ns when next message is allowed
+			std::atomic<std::uint64_t>	suppressed_;
 		};
 
 		/*!
@@ -3624,6 +4269,8 @@ namespace zz
 			Logger(std::string name) : name_(name)
 			{
 				levelMask_ = LogConfig::instance().log_level_mask();
+				textSinks_ = false;
+				binarySinks_ = false;
 			}
 
 			/*!
@@ -3634,6 +4281,8 @@ namespace zz
 			Logger(std::string name, int levelMask) : name_(name)
 			{
 				levelMask_ = levelMask;
+				textSinks_ = false;
+				binarySinks_ = false;
 			}
 
 			// logger.info(format string, arg1, arg2, arg3, ...) call style
@@ -3762,6 +4411,62 @@ namespace zz
 			 */
 			detail::LineLogger fatal();
 
+
+			// rate limited call style, state is kept in the LogSite passed in, which should outlive the calls,
+			// e.g. a static at the call site as created by ZZ_LOG_EVERY_N and the like.
+			// C++11 has no way to tell call sites apart without a macro, so there is no overload without LogSite,
+			// prefer the ZZ_LOG_EVERY_N, ZZ_LOG_EVERY and ZZ_LOG_FIRST_N macros.
+			// Before the next logged message, a summary of messages suppressed since is logged.
+
+			/*!
+			 * \fn template <typename... Args> detail::LineLogger log_every_n(LogLevels lvl, LogSite &site, std::size_t n, const char* fmt, const Args&... args)
+			 * \brief Log the first and then every n-th message from this call site.
+			 */
+			template <typename... Args> detail::LineLogger log_every_n(LogLevels lvl, LogSite &site, std::size_t n, const char* fmt, const Args&... args);
+
+			/*!
+			 * \fn template <typename Rep, typename Period, typename... Args> detail::LineLogger log_every(LogLevels lvl, LogSite &site, std::chrono::duration<Rep, Period> interval, const char* fmt, const Args&... args)
+			 * \brief Log at most one message per interval from this call site.
+			 */
+			template <typename Rep, typename Period, typename... Args>
+			detail::LineLogger log_every(LogLevels lvl, LogSite &site, std::chrono::duration<Rep, Period> interval, const char* fmt, const Args&... args);
+
+			/*!
+			 * \fn template <typename... Args> detail::LineLogger log_first_n(LogLevels lvl, LogSite &site, std::size_t n, std::size_t thenEveryN, const char* fmt, const Args&... args)
+			 * \brief Log the first n messages from this call site, then every thenEveryN-th one, 0 to stop.
+			 */
+			template <typename... Args> detail::LineLogger log_first_n(LogLevels lvl, LogSite &site, std::size_t n, std::size_t thenEveryN, const char* fmt, const Args&... args);
+
+			/*!
+			 * \brief Level specific versions of log_every_n(), log_every() and log_first_n()
+			 * e.g. static LogSite site; Logger.info_every_n(site, 100, format string, arg1, arg2, ...)
+			 * The LogSite is required, ZZ_LOG_EVERY_N(logger, info, 100, format string, ...) creates it for you.
+			 */
+			template <typename... Args> detail::LineLogger trace_every_n(LogSite &site, std::size_t n, const char* fmt, const Args&... args);
+			template <typename... Args> detail::LineLogger debug_every_n(LogSite &site, std::size_t n, const char* fmt, const Args&... args);
+			template <typename... Args> detail::LineLogger info_every_n(LogSite &site, std::size_t n, const char* fmt, const Args&... args);
+			template <typename... Args> detail::LineLogger warn_every_n(LogSite &site, std::size_t n, const char* fmt, const Args&... args);
+			template <typename... Args> detail::LineLogger error_every_n(LogSite &site, std::size_t n, const char* fmt, const Args&... args);
+			template <typename... Args> detail::LineLogger fatal_every_n(LogSite &site, std::size_t n, const char* fmt, const Args&... args);
+			template <typename Rep, typename Period, typename... Args>
+			detail::LineLogger trace_every(LogSite &site, std::chrono::duration<Rep, Period> interval, const char* fmt, const Args&... args);
+			template <typename Rep, typename Period, typename... Args>
+			detail::LineLogger debug_every(LogSite &site, std::chrono::duration<Rep, Period> interval, const char* fmt, const Args&... args);
+			template <typename Rep, typename Period, typename... Args>
+			detail::LineLogger info_every(LogSite &site, std::chrono::duration<Rep, Period> interval, const char* fmt, const Args&... args);
+			template <typename Rep, typename Period, typename... Args>
+			detail::LineLogger warn_every(LogSite &site, std::chrono::duration<Rep, Period> interval, const char* fmt, const Args&... args);
+			template <typename Rep, typename Period, typename... Args>
+			detail::LineLogger error_every(LogSite &site, std::chrono::duration<Rep, Period> interval, const char* fmt, const Args&... args);
+			template <typename Rep, typename Period, typename... Args>
+			detail::LineLogger fatal_every(LogSite &site, std::chrono::duration<Rep, Period> interval, const char* fmt, const Args&... args);
+			template <typename... Args> detail::LineLogger trace_first_n(LogSite &site, std::size_t n, std::size_t thenEveryN, const char* fmt, const Args&... args);
+			template <typename... Args> detail::LineLogger debug_first_n(LogSite &site, std::size_t n, std::size_t thenEveryN, const char* fmt, const Args&... args);
+			template <typename... Args> detail::LineLogger info_first_n(LogSite &site, std::size_t n, std::size_t thenEveryN, const char* fmt, const Args&... args);
+			template <typename... Args> detail::LineLogger warn_first_n(LogSite &site, std::size_t n, std::size_t thenEveryN, const char* fmt, const Args&... args);
+			template <typename... Args> detail::LineLogger error_first_n(LogSite &site, std::size_t n, std::size_t thenEveryN, const char* fmt, const Args&... args);
+			template <typename... Args> detail::LineLogger fatal_first_n(LogSite &site, std::size_t n, std::size_t thenEveryN, const char* fmt, const Args&... args);
+
 			//const LogLevels level() const
 			//{
 			//	return static_cast<LogLevels>(level_.load(std::memory_order_relaxed));
@@ -3786,6 +4491,13 @@ namespace zz
 				return level_should_log(levelMask_, msgLevel);
 			}
 
+			/*!
+			 * \brief Same as should_log(), but counts rejected levels as filtered in stats
+			 * \param lvl
+			 * \return True if the level should be logged
+			 */
+			bool should_log_counted(LogLevels lvl);
+
 			/*!
 			 * \brief Get name of the logger
 			 * \return Name of the logger
@@ -3795,9 +4507,16 @@ namespace zz
 			/*!
 			 * \brief Get user friendly information about this logger.
 			 * Get informations such as log levels, sink list, etc...
+			 * \param withStats Also show counters and latency of the logger and its sinks.
 			 * \return User friendly string info.
 			 */
-			std::string to_string();
+			std::string to_string(bool withStats = false);
+
+			/*!
+			 * \brief Get counters and latency of this logger
+			 * \return Reference to stats
+			 */
+			LogStats& stats() { return stats_; }
 
 			/*!
 			 * \brief Get pointer to a sink by name.
@@ -3853,11 +4572,38 @@ namespace zz
 			template<typename T>
 			detail::LineLogger log_if_enabled(LogLevels lvl, const T& msg);
 
-			void log_msg(detail::LogMessage msg);
+			template <typename... Args>
+			detail::LineLogger log_sampled(LogLevels lvl, bool enabled, std::uint64_t suppressed, const char* fmt, const Args&... args);
+
+			void log_msg(detail::LogMessage &&msg);
+
+			bool insert_sink(SinkPtr sink);
+
+			void erase_sink(const std::string &name);
+
+			/*!
+			 * \brief Immutable sink list, kinds are computed with the list so they always describe it
+			 */
+			struct SinkList
+			{
+				SinkList() : text_(false), binary_(false) {}
+				void update_kinds();
+
+				std::vector<SinkPtr>	sinks_;
+				bool					text_;		//!< has sinks requiring formatted text
+				bool					binary_;	//!< has sinks requiring raw arguments
+			};
+
+			void publish_sink_kinds(const SinkList &list);
 
 			std::string				name_;
 			std::atomic_int			levelMask_;
-			cds::lockbased::UnorderedMap<std::string, SinkPtr> sinks_;
+			cds::AtomicNonTrivial<SinkList> sinks_;	//!< immutable sink list, replaced on attach/detach
+			// hints for LineLogger to skip rendering or encoding, may lag behind sinks_,
+			// log_msg() renders text from raw arguments if the published list requires it
+			std::atomic_bool		textSinks_;
+			std::atomic_bool		binarySinks_;
+			LogStats				stats_;
 		};
 		typedef std::shared_ptr<Logger> LoggerPtr;
 
@@ -3967,21 +4713,239 @@ namespace zz
 				void operator = (mpmc_bounded_queue const&);
 			};
 
+			struct FormatToken
+			{
+				enum class Type
+				{
+					literal,
+					datetime,
+					logger,
+					thread,
+					level,
+					level_short,
+					message,
+					fields,
+					json
+				};
+
+				Type			type_;
+				std::string		text_;
+			};
+
+			typedef std::vector<FormatToken> CompiledFormat;
+
 			struct LogMessage
 			{
 				std::string			loggerName_;
 				LogLevels			level_;
-				time::DateTime			dateTime_;
+				std::chrono::system_clock::time_point	timeStamp_;
 				size_t				threadId_;
+				const std::string	*threadName_;	//!< interned by os::set_thread_name, nullptr or empty if not named
 				std::string			buffer_;
+
+				// raw arguments for binary sinks, formatId_ is 0 if not available
+				std::uint32_t		formatId_;
+				std::string			args_;
+
+				// key-value fields, encoded as pairs of string key and typed value
+				std::string			fields_;
+			};
+
+			/*!
+			 * \brief Reusable per thread message storage, so steady-state logging
+			 * keeps using the same heap buffers instead of allocating new ones.
+			 */
+			struct ThreadBuffers
+			{
+				std::string		loggerName_;
+				std::string		buffer_;
+				std::string		args_;
+				std::string		fields_;
+			};
+
+			/*!
+			 * \brief Get message storage cached by the calling thread
+			 * \return Reference to thread local buffers
+			 */
+			ThreadBuffers& thread_buffers();
+
+			/*!
+			 * \brief Per thread rendered text of the message being dispatched,
+			 * so sinks with identical formats render it only once.
+			 */
+			struct RenderCache
+			{
+				RenderCache() : msg_(nullptr), dispatching_(false), busy_(false) {}
+
+				const LogMessage						*msg_;	//!< message text_ belongs to, nullptr if none
+				std::shared_ptr<const CompiledFormat>	format_;
+				std::shared_ptr<const std::string>		datetimeFormat_;
+				std::string								text_;
+				bool									dispatching_;	//!< a logger is dispatching msg_ to its sinks
+				bool									busy_;	//!< text_ is in use by a sink
+			};
+
+			/*!
+			 * \brief Get render cache of the calling thread
+			 * \return Reference to thread local render cache
+			 */
+			RenderCache& render_cache();
+
+			/*!
+			 * \brief Enable sharing rendered text while a logger dispatches one message,
+			 * outside of it sinks always render, as message addresses are reused.
+			 */
+			class RenderScope : private UnCopyable
+			{
+			public:
+				RenderScope() : cache_(render_cache()), outer_(cache_.dispatching_)
+				{
+					cache_.msg_ = nullptr;
+					cache_.dispatching_ = true;
+				}
+
+				~RenderScope()
+				{
+					cache_.msg_ = nullptr;
+					cache_.dispatching_ = outer_;
+				}
+
+			private:
+				RenderCache	&cache_;
+				bool		outer_;
 			};
 
+			/*!
+			 * \brief Append value to output buffer as text, fast paths without iostreams.
+			 * Output is identical to std::ostream operator<<.
+			 * \param out Output buffer
+			 * \param value
+			 */
+			void append_value(std::string &out, const std::string &value);
+			void append_value(std::string &out, const char *value);
+			void append_value(std::string &out, char value);
+			void append_value(std::string &out, bool value);
+			void append_value(std::string &out, short value);
+			void append_value(std::string &out, unsigned short value);
+			void append_value(std::string &out, int value);
+			void append_value(std::string &out, unsigned int value);
+			void append_value(std::string &out, long value);
+			void append_value(std::string &out, unsigned long value);
+			void append_value(std::string &out, long long value);
+			void append_value(std::string &out, unsigned long long value);
+			void append_value(std::string &out, float value);
+			void append_value(std::string &out, double value);
+			void append_value(std::string &out, long double value);
+
+			/*!
+			 * \brief Generic version, fall back to std::ostream operator<<
+			 * \param out Output buffer
+			 * \param value
+			 */
+			template <typename T>
+			void append_value(std::string &out, const T &value)
+			{
+				std::ostringstream oss;
+				oss << std::dec << value;
+				out += oss.str();
+			}
+
+			/*!
+			 * \brief Append format text starting from pos until next "{}" placeholder,
+			 * escaped placeholder "%{}" is written as "{}".
+			 * \param out Output buffer
+			 * \param fmt Format string
+			 * \param pos Position in fmt, moved past the placeholder if found
+			 * \return True if a placeholder is found
+			 */
+			bool append_until_placeholder(std::string &out, const char *fmt, std::size_t &pos);
+
+			/*!
+			 * \brief Register format string for binary logging, same strings share one id.
+			 * Ids are cached per thread by address, so literal formats are resolved without locking.
+			 * \param fmt Format string
+			 * \return Id of the format, always greater than 0
+			 */
+			std::uint32_t register_binary_format(const char *fmt);
+
+			/*!
+			 * \brief Get registered binary format by id
+			 * \param id
+			 * \return Format string, throw if id is not registered
+			 */
+			std::string binary_format(std::uint32_t id);
+
+			/*!
+			 * \brief Encode argument as tagged raw bytes in native byte order, used by binary sinks
+			 * \param out Output buffer
+			 * \param value
+			 */
+			void encode_arg(std::string &out, const std::string &value);
+			void encode_arg(std::string &out, const char *value);
+			void encode_arg(std::string &out, char value);
+			void encode_arg(std::string &out, bool value);
+			void encode_arg(std::string &out, short value);
+			void encode_arg(std::string &out, unsigned short value);
+			void encode_arg(std::string &out, int value);
+			void encode_arg(std::string &out, unsigned int value);
+			void encode_arg(std::string &out, long value);
+			void encode_arg(std::string &out, unsigned long value);
+			void encode_arg(std::string &out, long long value);
+			void encode_arg(std::string &out, unsigned long long value);
+			void encode_arg(std::string &out, float value);
+			void encode_arg(std::string &out, double value);
+			void encode_arg(std::string &out, long double value);
+
+			/*!
+			 * \brief Generic version, encoded as text
+			 * \param out Output buffer
+			 * \param value
+			 */
+			template <typename T>
+			void encode_arg(std::string &out, const T &value)
+			{
+				std::string text;
+				append_value(text, value);
+				encode_arg(out, text);
+			}
+
+			inline void encode_args(std::string&) {}
+
+			template <typename Arg, typename... Args>
+			void encode_args(std::string &out, const Arg &arg, const Args&... args)
+			{
+				encode_arg(out, arg);
+				encode_args(out, args...);
+			}
+
+			/*!
+			 * \brief Render format with encoded arguments, the same as LineLogger::write(fmt, args...)
+			 * \param fmt Format string
+			 * \param data Encoded arguments
+			 * \param size Size of encoded arguments in bytes
+			 * \param out Output buffer
+			 * \return False if arguments are corrupted
+			 */
+			bool decode_args(const std::string &fmt, const char *data, std::size_t size, std::string &out);
+
+			/*!
+			 * \brief Monotonic time for latency measurement
+			 * \return Steady clock time in ns
+			 */
+			inline std::uint64_t steady_ns()
+			{
+				return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now().time_since_epoch()).count());
+			}
+
 			class LineLogger : private UnCopyable
 			{
 			public:
 				LineLogger(Logger* callbacker, LogLevels lvl, bool enable) :callbackLogger_(callbacker), enabled_(enable)
 				{
 					msg_.level_ = lvl;
+					msg_.formatId_ = 0;
+					if (enabled_) acquire_buffers();
 				}
 
 				LineLogger(LineLogger&& other) :
@@ -3996,10 +4960,12 @@ namespace zz
 				{
 					if (enabled_)
 					{
-						msg_.loggerName_ = callbackLogger_->name();
-						msg_.dateTime_ = time::DateTime::local_time();
+						msg_.loggerName_ = callbackLogger_->name_;
+						msg_.timeStamp_ = std::chrono::system_clock::now();
 						msg_.threadId_ = os::thread_id();
-						callbackLogger_->log_msg(msg_);
+						msg_.threadName_ = &os::thread_name();
+						callbackLogger_->log_msg(std::move(msg_));
+						release_buffers();
 					}
 				}
 
@@ -4007,40 +4973,56 @@ namespace zz
 
 				void write(const char* what)
 				{
-					if (enabled_)
-						msg_.buffer_ += what;
+					if (!enabled_) return;
+					flatten_args();
+					msg_.buffer_ += what;
 				}
 
 				template <typename... Args>
 				void write(const char* fmt, const Args&... args)
 				{
 					if (!enabled_) return;
-					std::string buf(fmt);
-					fmt::format_string(buf, args...);
-					msg_.buffer_ += buf;
-				}
-
-
-				LineLogger& operator<<(const char* what)
-				{
-					if (enabled_) msg_.buffer_ += what;
-					return *this;
+					if (msg_.formatId_ == 0 && msg_.buffer_.empty() && callbackLogger_->binarySinks_)
+					{
+						// keep raw arguments for binary sinks, text is rendered only if required
+						msg_.formatId_ = register_binary_format(fmt);
+						encode_args(msg_.args_, args...);
+						if (!callbackLogger_->textSinks_) return;
+					}
+					else
+					{
+						flatten_args();
+					}
+					std::size_t pos = 0;
+					write_args(fmt, pos, args...);
+					msg_.buffer_ += fmt + pos;
 				}
 
-				LineLogger& operator<<(const std::string& what)
+				template<typename T>
+				LineLogger& operator<<(const T& what)
 				{
-					if (enabled_) msg_.buffer_ += what;
+					if (enabled_)
+					{
+						flatten_args();
+						append_value(msg_.buffer_, what);
+					}
 					return *this;
 				}
 
+				/*!
+				 * \brief Attach key-value field, value is kept typed until rendered by %fields or %json in sink format.
+				 * e.g. logger->info("request done").with("user", id).with("latency_us", t)
+				 * \param key Field name
+				 * \param value Field value
+				 * \return Reference to this line logger
+				 */
 				template<typename T>
-				LineLogger& operator<<(const T& what)
+				LineLogger& with(const char *key, const T& value)
 				{
 					if (enabled_)
 					{
-						std::ostringstream oss;
-						oss << std::dec << what;
-						msg_.buffer_ += oss.str();
+						encode_arg(msg_.fields_, key);
+						encode_arg(msg_.fields_, value);
 					}
 					return *this;
 				}
@@ -4055,29 +5037,255 @@ namespace zz
 					return enabled_;
 				}
 			private:
+				void acquire_buffers()
+				{
+					ThreadBuffers &tb = thread_buffers();
+					msg_.loggerName_.swap(tb.loggerName_);
+					msg_.buffer_.swap(tb.buffer_);
+					msg_.args_.swap(tb.args_);
+					msg_.fields_.swap(tb.fields_);
+					msg_.buffer_.clear();
+					msg_.args_.clear();
+					msg_.fields_.clear();
+				}
+
+				void release_buffers()
+				{
+					// message may be moved away by sinks, only keep the larger buffers
+					ThreadBuffers &tb = thread_buffers();
+					if (msg_.loggerName_.capacity() > tb.loggerName_.capacity()) msg_.loggerName_.swap(tb.loggerName_);
+					if (msg_.buffer_.capacity() > tb.buffer_.capacity()) msg_.buffer_.swap(tb.buffer_);
+					if (msg_.args_.capacity() > tb.args_.capacity()) msg_.args_.swap(tb.args_);
+					if (msg_.fields_.capacity() > tb.fields_.capacity()) msg_.fields_.swap(tb.fields_);
+				}
+
+				void flatten_args()
+				{
+					// message is extended as text, raw arguments no longer describe it
+					if (msg_.formatId_ == 0) return;
+					if (msg_.buffer_.empty())
+					{
+						decode_args(binary_format(msg_.formatId_), msg_.args_.data(), msg_.args_.size(), msg_.buffer_);
+					}
+					msg_.formatId_ = 0;
+					msg_.args_.clear();
+				}
+
+				void write_args(const char*, std::size_t&) {}
+
+				template <typename Arg, typename... Args>
+				void write_args(const char* fmt, std::size_t &pos, const Arg& arg, const Args&... args)
+				{
+					if (!append_until_placeholder(msg_.buffer_, fmt, pos)) return;
+					append_value(msg_.buffer_, arg);
+					write_args(fmt, pos, args...);
+				}
+
 				Logger			*callbackLogger_;
 				LogMessage		msg_;
 				bool			enabled_;
 			};
 
+			/*!
+			 * \brief Compile sink format into token list, so specifiers are resolved only once
+			 * \param format Sink format, e.g. consts::kDefaultLoggerFormat
+			 * \return Sequence of literal and specifier tokens
+			 */
+			CompiledFormat compile_format(const std::string &format);
+
+			/*!
+			 * \brief Get shared compiled format, sinks with identical format string share one instance.
+			 * Only formats still used by some sink are kept.
+			 * \param format Sink format
+			 * \return Shared pointer to immutable compiled format
+			 */
+			std::shared_ptr<const CompiledFormat> get_compiled_format(const std::string &format);
+
+			/*!
+			 * \brief Render message with compiled format, append to output buffer
+			 * \param format Compiled sink format
+			 * \param datetimeFormat Datetime format used for the datetime specifier
+			 * \param msg
+			 * \param out Output buffer, always ends with a new line
+			 */
+			void render_message(const CompiledFormat &format, const std::string &datetimeFormat, const LogMessage &msg, std::string &out);
+
+			/*!
+			 * \brief Render local datetime of time stamp, append to output buffer.
+			 * Rendered datetime is cached per thread and reused within the same second,
+			 * only the fraction part is patched for each call.
+			 * \param datetimeFormat Datetime format, see time::DateTime::to_string()
+			 * \param timeStamp
+			 * \param out
+			 */
+			void render_datetime(const std::string &datetimeFormat, std::chrono::system_clock::time_point timeStamp, std::string &out);
+
 			class SinkInterface
 			{
 			public:
 				virtual ~SinkInterface() {};
 				virtual void log(const LogMessage& msg) = 0;
+				// log and take over the message, for sinks which need to keep a copy
+				virtual void consume(LogMessage&& msg) { log(msg); }
+				// log with the format of a wrapper instead of the sink's own, e.g. for AsyncSink
+				virtual void log_with_format(const LogMessage& msg, const std::shared_ptr<const CompiledFormat>&) { log(msg); }
 				virtual void flush() = 0;
 				virtual std::string name() const = 0;
 				virtual std::string to_string() const = 0;
 				virtual void set_level_mask(int levelMask) = 0;
 				virtual void set_format(const std::string &fmt) = 0;
+				// binary sinks take raw arguments instead of formatted text
+				virtual bool is_binary() const { return false; }
+				// counters and latency of the sink
+				LogStats& stats() { return stats_; }
+				const LogStats& stats() const { return stats_; }
+
+			protected:
+				LogStats		stats_;
 			};
 
 			// Due to a bug in VC12, thread join in static object dtor
-			// will cause deadlock. TODO: implement async sink when
-			// VS2015 ready.
+			// will cause deadlock. Drop async sinks before main() returns
+			// if built with VS2013.
 			class AsyncSink : public SinkInterface, private UnCopyable
 			{
+			public:
+				AsyncSink(SinkPtr sink, std::size_t queueSize = consts::kAsyncQueueSize,
+					OverflowPolicy policy = OverflowPolicy::block, LogLevels dropBelow = LogLevels::warn);
+
+				~AsyncSink();
+
+				void log(const LogMessage& msg) override;
+
+				void consume(LogMessage&& msg) override;
+
+				void flush() override;
+
+				std::string name() const override
+				{
+					return name_;
+				}
+
+				std::string to_string() const override
+				{
+					return "AsyncSink->{" + sink_->to_string() + "} overflow: "
+						+ consts::kOverflowPolicyNames[policy_] + " dropped: " + std::to_string(stats_.dropped_.load());
+				}
+
+				void set_overflow_policy(OverflowPolicy policy, LogLevels dropBelow = LogLevels::warn)
+				{
+					dropBelow_ = dropBelow;
+					policy_ = static_cast<int>(policy);
+				}
+
+				OverflowPolicy overflow_policy() const
+				{
+					return static_cast<OverflowPolicy>(policy_.load());
+				}
+
+				std::size_t dropped_count() const
+				{
+					return static_cast<std::size_t>(stats_.dropped_.load());
+				}
+
+				/*!
+				 * \brief Filter levels before queueing, the backend sink may be shared
+				 * with other loggers so its own level mask is left untouched and still applies.
+				 * \param levelMask
+				 */
+				void set_level_mask(int levelMask) override
+				{
+					levelMask_ = levelMask & LogLevels::sentinel;
+				}
+
+				int level_mask() const
+				{
+					return levelMask_;
+				}
+
+				/*!
+				 * \brief Render messages of this sink with format instead of the backend's own,
+				 * the backend sink may be shared so its format is left untouched.
+				 * \param fmt
+				 */
+				void set_format(const std::string &fmt) override
+				{
+					format_.set(get_compiled_format(fmt));
+				}
+
+				bool is_binary() const override
+				{
+					return sink_->is_binary();
+				}
+
+				SinkPtr backend() const
+				{
+					return sink_;
+				}
+
+			private:
+				void start();
+				void stop();
+				void bg_work();
+				void enqueue_blocking(LogMessage &msg);
+				void report_dropped();
+				// write to backend with the format of this sink if set
+				void write_backend(const LogMessage &msg);
+
+				SinkPtr							sink_;
+				std::string						name_;
+				std::atomic_int					levelMask_;
+				cds::AtomicNonTrivial<CompiledFormat>	format_;	//!< nullptr to use the backend format
+				mpmc_bounded_queue<LogMessage>	queue_;
+				std::atomic<std::size_t>		pending_;
+				std::atomic_int					policy_;
+				std::atomic_int					dropBelow_;
+				std::uint64_t					reported_;
+				std::atomic_bool				running_;
+				std::thread						worker_;
+			};
+
+			/*!
+			 * \brief Text of a message rendered for one sink, borrowed from the render cache.
+			 * Messages logged from inside a sink render into their own buffer,
+			 * so the borrowed text stays valid until this is destroyed.
+			 */
+			class RenderedLine : private UnCopyable
+			{
+			public:
+				RenderedLine(const LogMessage &msg, const std::shared_ptr<const CompiledFormat> &format)
+					: cache_(render_cache()), owner_(!cache_.busy_)
+				{
+					auto datetimeFormat = LogConfig::instance().datetime_format_ptr();
+					if (!owner_)
+					{
+						render_message(*format, *datetimeFormat, msg, local_);
+						return;
+					}
+					cache_.busy_ = true;
+					// reuse if already rendered by previous sink with the same format
+					if (cache_.msg_ == &msg && cache_.format_ == format && cache_.datetimeFormat_ == datetimeFormat) return;
+					cache_.text_.clear();
+					render_message(*format, *datetimeFormat, msg, cache_.text_);
+					cache_.msg_ = cache_.dispatching_ ? &msg : nullptr;
+					cache_.format_ = format;
+					cache_.datetimeFormat_ = datetimeFormat;
+				}
+
+				~RenderedLine()
+				{
+					if (owner_) cache_.busy_ = false;
+				}
 
+				const std::string& str() const
+				{
+					return owner_ ? cache_.text_ : local_;
+				}
+
+			private:
+				RenderCache	&cache_;
+				bool		owner_;
+				std::string	local_;
 			};
 
 			class Sink : public SinkInterface, private UnCopyable
@@ -4093,12 +5301,26 @@ namespace zz
 
 				void log(const LogMessage& msg) override
 				{
-					if (!level_should_log(levelMask_, msg.level_)) return;
-					std::string finalMessage = format_message(msg);
+					log_with_format(msg, format_.get());
+				}
+
+				void log_with_format(const LogMessage& msg, const std::shared_ptr<const CompiledFormat> &format) override
+				{
+					if (!level_should_log(levelMask_, msg.level_))
+					{
+						stats_.filtered_.fetch_add(1, std::memory_order_relaxed);
+						return;
+					}
+					RenderedLine line(msg, format);
+					bool timed = LogConfig::instance().latency_stats();
 					// mutex for multi-thread race, actually vc++ and gnu++ are ok without lock
 					// but this behavior is not guanranteed, and libc++ will have corrupt output
 					std::lock_guard<std::mutex> lock(mutex_);
-					sink_it(finalMessage);
+					std::uint64_t start = timed ? steady_ns() : 0;
+					sink_it(line.str(), msg.level_);
+					if (timed) stats_.latency_.record(steady_ns() - start);
+					stats_.accepted_.fetch_add(1, std::memory_order_relaxed);
+					stats_.bytes_.fetch_add(line.str().size(), std::memory_order_relaxed);
 				}
 
 				void set_level_mask(int levelMask) override
@@ -4113,36 +5335,177 @@ namespace zz
 
 				void set_format(const std::string &format) override
 				{
-					format_.set(format);
+					format_.set(get_compiled_format(format));
 				}
 
-				virtual void sink_it(const std::string &finalMsg) = 0;
+				virtual void sink_it(const std::string &finalMsg, LogLevels level) = 0;
+
+			protected:
+				std::mutex			mutex_;	//!< held during sink_it()
 
 			private:
-				std::string format_message(const LogMessage &msg)
+				std::atomic_int		levelMask_;
+				cds::AtomicNonTrivial<CompiledFormat>		format_;
+			};
+
+			/*!
+			 * \brief Accumulate lines in memory and write them to file in one call when full
+			 */
+			class WriteBatch
+			{
+			public:
+				explicit WriteBatch(std::size_t capacity) : capacity_(capacity)
 				{
-					std::string ret(format_.get());
-					auto dt = msg.dateTime_;
-					fmt::replace_all_with_escape(ret, consts::kSinkDatetimeSpecifier, dt.to_string(LogConfig::instance().datetime_format().c_str()));
-					fmt::replace_all_with_escape(ret, consts::kSinkLoggerNameSpecifier, msg.loggerName_);
-					fmt::replace_all_with_escape(ret, consts::kSinkThreadSpecifier, std::to_string(msg.threadId_));
-					fmt::replace_all_with_escape(ret, consts::kSinkLevelSpecifier, consts::kLevelNames[msg.level_]);
-					fmt::replace_all_with_escape(ret, consts::kSinkLevelShortSpecifier, consts::kShortLevelNames[msg.level_]);
-					fmt::replace_all_with_escape(ret, consts::kSinkMessageSpecifier, msg.buffer_);
-					// make sure new line
-					if (!fmt::ends_with(ret, "\n")) ret += os::endl();
-					return ret;
+					buffer_.reserve(capacity_);
 				}
 
-				std::atomic_int		levelMask_;
-				std::mutex			mutex_;
-				cds::lockbased::NonTrivialContainer<std::string>		format_;
+				/*!
+				 * \brief Add line to batch, write batch if it is full
+				 * \param file
+				 * \param line
+				 * \param urgent Write and flush file immediately, e.g. for errors
+				 */
+				void add(fs::FileEditor &file, const std::string &line, bool urgent)
+				{
+					if (buffer_.size() + line.size() > capacity_) drain(file);
+					if (line.size() > capacity_) file.write(line.data(), line.size());
+					else buffer_ += line;
+					if (urgent)
+					{
+						drain(file);
+						file.flush();
+					}
+				}
+
+				/*!
+				 * \brief Write all pending lines to file
+				 * \param file
+				 */
+				void drain(fs::FileEditor &file)
+				{
+					if (buffer_.empty()) return;
+					file.write(buffer_.data(), buffer_.size());
+					buffer_.clear();
+				}
+
+			private:
+				std::size_t		capacity_;
+				std::string		buffer_;
+			};
+
+			/*!
+			 * \brief Flush registered sinks periodically in a background thread,
+			 * so buffered lines are written even if no more messages come.
+			 * The instance is never destroyed, joining a thread in a static destructor
+			 * deadlocks in VC12, call stop() instead, e.g. via drop_all_loggers().
+			 */
+			class SinkFlusher : private UnMovable
+			{
+			public:
+				static SinkFlusher& instance();
+
+				/*!
+				 * \brief Flush sink every interval until it is destroyed
+				 * \param sink
+				 * \param interval Interval in ms
+				 */
+				void add(SinkPtr sink, int interval);
+
+				/*!
+				 * \brief Stop and join the background thread,
+				 * registered sinks are flushed again once the next add() restarts it.
+				 */
+				void stop();
+
+			private:
+				SinkFlusher() : stop_(false) {}
+
+				void run();
+
+				struct Entry
+				{
+					std::weak_ptr<SinkInterface>			sink_;
+					std::chrono::milliseconds				interval_;
+					std::chrono::steady_clock::time_point	next_;
+				};
+
+				std::mutex				controlMutex_;	//!< serializes thread start and stop
+				std::mutex				mutex_;
+				std::condition_variable	cv_;
+				std::vector<Entry>		entries_;
+				bool					stop_;
+				std::thread				worker_;
+			};
+
+			/*!
+			 * \brief Compress file to gzip format
+			 * \param src Source filename
+			 * \param dst Destination filename
+			 * \return True on success
+			 */
+			bool gzip_file(std::string src, std::string dst);
+
+			/*!
+			 * \brief Decompress gzip file written by gzip_file(), checksum and size are verified
+			 * \param src Source filename
+			 * \param content Decompressed content
+			 * \return True on success
+			 */
+			bool gunzip_file(std::string src, std::string &content);
+
+			/*!
+			 * \brief Run tasks one by one in a background thread, thread is started on first task.
+			 * Pending tasks are finished before destruction.
+			 */
+			class BackgroundWorker : private UnMovable
+			{
+			public:
+				/*!
+				 * \brief BackgroundWorker constructor
+				 * \param maxTasks Maximum queued tasks accepted by try_post, 0 for unlimited
+				 * \param lowPriority Run tasks with lowered thread priority
+				 */
+				BackgroundWorker(std::size_t maxTasks = 0, bool lowPriority = false)
+					: maxTasks_(maxTasks), lowPriority_(lowPriority), stop_(false), busy_(false) {}
+
+				~BackgroundWorker();
+
+				/*!
+				 * \brief Queue task to be run in background
+				 * \param task
+				 */
+				void post(std::function<void()> task);
+
+				/*!
+				 * \brief Queue task unless the queue is full
+				 * \param task
+				 * \return False if task is dropped
+				 */
+				bool try_post(std::function<void()> task);
+
+				/*!
+				 * \brief Block until all queued tasks are done
+				 */
+				void wait_idle();
+
+			private:
+				void run();
+
+				std::size_t							maxTasks_;
+				bool								lowPriority_;
+				std::mutex							mutex_;
+				std::condition_variable				cv_;
+				std::deque<std::function<void()>>	tasks_;
+				bool								stop_;
+				bool								busy_;
+				std::thread							worker_;
 			};
 
 			class SimpleFileSink : public Sink
 			{
 			public:
-				SimpleFileSink(const std::string filename, bool truncate) :fileEditor_(filename, truncate)
+				SimpleFileSink(const std::string filename, bool truncate, std::size_t bufferSize)
+					:fileEditor_(filename, truncate), batch_(bufferSize)
 				{
 				}
 
@@ -4150,12 +5513,14 @@ namespace zz
 
 				void flush() override
 				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					batch_.drain(fileEditor_);
 					fileEditor_.flush();
 				}
 
-				void sink_it(const std::string &finalMsg) override
+				void sink_it(const std::string &finalMsg, LogLevels level) override
 				{
-					fileEditor_ << finalMsg;
+					batch_.add(fileEditor_, finalMsg, level >= LogLevels::error);
 				}
 
 				std::string name() const override
@@ -4169,34 +5534,45 @@ namespace zz
 				}
 
 			private:
-				fs::FileEditor fileEditor_;
+				fs::FileEditor	fileEditor_;
+				WriteBatch		batch_;
 			};
 
+			/*!
+			 * \brief Sink rotating file by size and/or time.
+			 * Next file is opened in advance, so rotation is only a swap for writers,
+			 * renaming and pruning of backups are done by a background worker.
+			 */
 			class RotateFileSink : public Sink
 			{
 			public:
-				RotateFileSink(const std::string filename, std::size_t maxSizeInByte, bool backup);
+				RotateFileSink(const std::string filename, std::size_t maxSizeInByte, bool backup, std::size_t bufferSize,
+					RotateInterval interval, std::size_t maxBackups, bool compress);
 
-				~RotateFileSink() { flush(); }
+				~RotateFileSink();
 
 				void flush() override
 				{
-					fileEditor_.flush();
+					std::lock_guard<std::mutex> lock(mutex_);
+					batch_.drain(*file_);
+					file_->flush();
 				}
 
-				void sink_it(const std::string &finalMsg) override
+				void sink_it(const std::string &finalMsg, LogLevels level) override
 				{
 					currentSize_ += finalMsg.length();
-					if (currentSize_ > maxSizeInByte_)
+					if ((maxSizeInByte_ > 0 && currentSize_ > maxSizeInByte_)
+						|| (interval_ != RotateInterval::none && std::chrono::system_clock::now() >= nextRotateTime_))
 					{
 						rotate();
+						currentSize_ = finalMsg.length();
 					}
-					fileEditor_ << finalMsg;
+					batch_.add(*file_, finalMsg, level >= LogLevels::error);
 				}
 
 				std::string name() const override
 				{
-					return fileEditor_.filename();
+					return filename_;
 				}
 
 				std::string to_string() const override
@@ -4204,15 +5580,145 @@ namespace zz
 					return "RotateFileSink->" + name() + " " + level_mask_to_string(level_mask());
 				}
 
+				/*!
+				 * \brief Wait until background renaming is done
+				 */
+				void wait_rotation()
+				{
+					worker_.wait_idle();
+				}
+
 			private:
-				void back_up(std::string oldFile);
 				void rotate();
+				void finish_rotation();
+				void open_next();
+				void back_up(std::string oldFile);
+				void scan_backups();
+				void add_backup(const std::string &backupName);
+				void prune_backups();
+				std::chrono::system_clock::time_point next_rotate_time() const;
+
+				std::string								filename_;
+				std::string								nextFilename_;
+				std::unique_ptr<fs::FileEditor>			file_;
+				std::unique_ptr<fs::FileEditor>			next_;		//!< pre-opened next file, guarded by nextMutex_
+				std::mutex								nextMutex_;
+				WriteBatch								batch_;
+				std::size_t								maxSizeInByte_;
+				std::size_t								currentSize_;	//!< guarded by sink mutex
+				bool									backup_;
+				RotateInterval							interval_;
+				std::chrono::system_clock::time_point	nextRotateTime_;
+				std::size_t								maxBackups_;
+				std::deque<std::string>					backups_;	//!< existing backups, oldest first, used by compressor thread if compressing, otherwise by worker
+				bool									compress_;
+				BackgroundWorker						compressor_;
+				BackgroundWorker						worker_;
+			};
+
+			/*!
+			 * \brief Header of ring log file, followed by capacity bytes of circular data.
+			 * writePos_ counts all bytes ever written, data wrapped if it exceeds capacity_.
+			 */
+			struct RingLogHeader
+			{
+				char			magic_[8];
+				std::uint64_t	capacity_;
+				std::uint64_t	writePos_;
+			};
+
+			/*!
+			 * \brief Sink writing lines into a memory mapped file used as circular buffer.
+			 * Each line costs a memcpy, no system call involved, content survives process crash.
+			 * Use read_ring_log() to get lines back in order.
+			 */
+			class RingFileSink : public Sink
+			{
+			public:
+				RingFileSink(const std::string filename, std::size_t capacity);
+
+				~RingFileSink() { flush(); }
+
+				void flush() override
+				{
+					mmf_.flush();
+				}
+
+				void sink_it(const std::string &finalMsg, LogLevels level) override;
+
+				std::string name() const override
+				{
+					return mmf_.filename();
+				}
+
+				std::string to_string() const override
+				{
+					return "RingFileSink->" + name() + " " + level_mask_to_string(level_mask());
+				}
 
-				fs::FileEditor				fileEditor_;
-				std::mutex					mutex_;
-				std::size_t					maxSizeInByte_;
-				std::atomic<std::size_t>	currentSize_;
-				bool						backup_;
+			private:
+				fs::MemoryMappedFile	mmf_;
+				RingLogHeader			*header_;
+				char					*ring_;
+				std::size_t				capacity_;
+			};
+
+			/*!
+			 * \brief Sink writing raw arguments instead of text, formatting is done offline by decode_binary_log().
+			 * Each session starts with kBinaryLogMagic and version, format strings are written once as
+			 * 'F' records(id, string), messages as 'M' records(level, time, thread, logger, format id, arguments).
+			 */
+			class BinaryFileSink : public SinkInterface, private UnCopyable
+			{
+			public:
+				BinaryFileSink(const std::string filename, bool truncate);
+
+				~BinaryFileSink() { flush(); }
+
+				void log(const LogMessage& msg) override;
+
+				void flush() override
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					fileEditor_.flush();
+				}
+
+				std::string name() const override
+				{
+					return fileEditor_.filename();
+				}
+
+				std::string to_string() const override
+				{
+					return "BinaryFileSink->" + name() + " " + level_mask_to_string(levelMask_);
+				}
+
+				void set_level_mask(int levelMask) override
+				{
+					levelMask_ = levelMask & LogLevels::sentinel;
+				}
+
+				/*!
+				 * \brief Binary logs carry no text format, it is chosen when decoding.
+				 * Throw ArgException so a format request is not lost silently.
+				 */
+				void set_format(const std::string &fmt) override
+				{
+					throw ArgException("Binary file sink: " + name() + " has no text format, pass format \"" + fmt + "\" to decode_binary_log() instead");
+				}
+
+				bool is_binary() const override
+				{
+					return true;
+				}
+
+			private:
+				std::atomic_int		levelMask_;
+				std::mutex			mutex_;
+				fs::FileEditor		fileEditor_;
+				std::vector<bool>	knownFormats_;	//!< formats already written in this session
+				std::string			record_;
+				std::string			textArgs_;
 			};
 
 			class OStreamSink : public Sink
@@ -4236,7 +5742,7 @@ namespace zz
 				}
 
 			private:
-				void sink_it(const std::string &finalMsg) override
+				void sink_it(const std::string &finalMsg, LogLevels) override
 				{
 					ostream_ << finalMsg;
 					if (forceFlush_) ostream_.flush();
@@ -4283,14 +5789,90 @@ namespace zz
 				}
 				static std::shared_ptr<StderrSink> instance()
 				{
-					static std::shared_ptr<StderrSink> instance = std::make_shared<StderrSink>();
-					return instance;
+					static std::shared_ptr<StderrSink> instance = std::make_shared<StderrSink>();
+					return instance;
+				}
+
+				std::string to_string() const override
+				{
+					return "StderrSink->" + name() + " " + level_mask_to_string(level_mask());
+				}
+			};
+
+			/*!
+			 * \brief Sink formats messages but discards them, to measure logging cost without I/O
+			 */
+			class NullSink : public Sink
+			{
+			public:
+				explicit NullSink(const std::string name) : name_(name) {}
+
+				void flush() override {}
+
+				void sink_it(const std::string &, LogLevels) override {}
+
+				std::string name() const override
+				{
+					return name_;
+				}
+
+				std::string to_string() const override
+				{
+					return "NullSink->" + name() + " " + level_mask_to_string(level_mask());
+				}
+
+			private:
+				std::string		name_;
+			};
+
+			/*!
+			 * \brief Sink keeps the last lines in memory for retrieval at runtime.
+			 * Writers claim slots in a ring without locking, a line is dropped if its slot
+			 * is still being written by a writer that wrapped around.
+			 */
+			class MemorySink : public Sink
+			{
+			public:
+				MemorySink(const std::string name, std::size_t capacity, std::size_t lineSize);
+
+				void log_with_format(const LogMessage& msg, const std::shared_ptr<const CompiledFormat> &format) override;
+
+				void flush() override {}
+
+				// lines are written by log_with_format() directly
+				void sink_it(const std::string &, LogLevels) override {}
+
+				std::string name() const override
+				{
+					return name_;
 				}
 
 				std::string to_string() const override
 				{
-					return "StderrSink->" + name() + " " + level_mask_to_string(level_mask());
+					return "MemorySink->" + name() + " " + level_mask_to_string(level_mask());
 				}
+
+				/*!
+				 * \brief Get stored lines, can be called while logging
+				 * \return Rendered lines from oldest to newest
+				 */
+				std::vector<std::string> lines() const;
+
+			private:
+				// seqlock per slot, odd sequence while being written
+				struct Slot
+				{
+					std::atomic<std::uint64_t>	seq_;
+					std::atomic<std::uint64_t>	ticket_;
+					std::atomic<std::size_t>	size_;
+				};
+
+				std::string						name_;
+				std::size_t						capacity_;
+				std::size_t						lineSize_;
+				std::unique_ptr<Slot[]>			slots_;
+				std::unique_ptr<char[]>			data_;
+				std::atomic<std::uint64_t>		head_;
 			};
 
 			class LoggerRegistry : UnMovable
@@ -4307,26 +5889,41 @@ namespace zz
 				void unlock();
 				bool is_locked() const;
 
+				/*!
+				 * \brief Counter bumped whenever loggers are dropped, so cached lookups can be revalidated
+				 * \return Current generation
+				 */
+				std::uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+
 			private:
-				LoggerRegistry(){ lock_ = false; }
+				LoggerRegistry(){ lock_ = false; generation_ = 0; }
 
 				LoggerPtr new_registry(const std::string &name);
 
-				cds::lockbased::UnorderedMap<std::string, LoggerPtr> loggers_;
+				typedef std::unordered_map<std::string, LoggerPtr> LoggerMap;
+				cds::AtomicNonTrivial<LoggerMap> loggers_;	//!< immutable snapshot, lookups take no lock
 				std::atomic_bool	lock_;
+				std::atomic<std::uint64_t>	generation_;
 			};
 		} // namespace detail
 
+		inline bool Logger::should_log_counted(LogLevels lvl)
+		{
+			if (should_log(lvl)) return true;
+			stats_.filtered_.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
 		inline detail::LineLogger Logger::log_if_enabled(LogLevels lvl)
 		{
-			detail::LineLogger l(this, lvl, should_log(lvl));
+			detail::LineLogger l(this, lvl, should_log_counted(lvl));
 			return l;
 		}
 
 		template <typename... Args>
 		inline detail::LineLogger Logger::log_if_enabled(LogLevels lvl, const char* fmt, const Args&... args)
 		{
-			detail::LineLogger l(this, lvl, should_log(lvl));
+			detail::LineLogger l(this, lvl, should_log_counted(lvl));
 			l.write(fmt, args...);
 			return l;
 		}
@@ -4334,7 +5931,7 @@ namespace zz
 		template<typename T>
 		inline detail::LineLogger Logger::log_if_enabled(LogLevels lvl, const T& msg)
 		{
-			detail::LineLogger l(this, lvl, should_log(lvl));
+			detail::LineLogger l(this, lvl, should_log_counted(lvl));
 			l.write(msg);
 			return l;
 		}
@@ -4372,6 +5969,133 @@ namespace zz
 		}
 
 
+		// rate limited call style
+		template <typename... Args>
+		inline detail::LineLogger Logger::log_sampled(LogLevels lvl, bool enabled, std::uint64_t suppressed, const char* fmt, const Args&... args)
+		{
+			if (!enabled) stats_.filtered_.fetch_add(1, std::memory_order_relaxed);
+			else if (suppressed > 0) log_if_enabled(lvl, consts::kSuppressedMessageFormat, suppressed);
+			detail::LineLogger l(this, lvl, enabled);
+			l.write(fmt, args...);
+			return l;
+		}
+
+		template <typename... Args>
+		inline detail::LineLogger Logger::log_every_n(LogLevels lvl, LogSite &site, std::size_t n, const char* fmt, const Args&... args)
+		{
+			std::uint64_t suppressed = 0;
+			bool enabled = should_log(lvl) && site.every_n(n, suppressed);
+			return log_sampled(lvl, enabled, suppressed, fmt, args...);
+		}
+
+		template <typename Rep, typename Period, typename... Args>
+		inline detail::LineLogger Logger::log_every(LogLevels lvl, LogSite &site, std::chrono::duration<Rep, Period> interval, const char* fmt, const Args&... args)
+		{
+			std::uint64_t suppressed = 0;
+			bool enabled = should_log(lvl) && site.every(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count(), suppressed);
+			return log_sampled(lvl, enabled, suppressed, fmt, args...);
+		}
+
+		template <typename... Args>
+		inline detail::LineLogger Logger::log_first_n(LogLevels lvl, LogSite &site, std::size_t n, std::size_t thenEveryN, const char* fmt, const Args&... args)
+		{
+			std::uint64_t suppressed = 0;
+			bool enabled = should_log(lvl) && site.first_n(n, thenEveryN, suppressed);
+			return log_sampled(lvl, enabled, suppressed, fmt, args...);
+		}
+		template <typename... Args>
+		inline detail::LineLogger Logger::trace_every_n(LogSite &site, std::size_t n, const char* fmt, const Args&... args)
+		{
+			return log_every_n(LogLevels::trace, site, n, fmt, args...);
+		}
+		template <typename... Args>
+		inline detail::LineLogger Logger::debug_every_n(LogSite &site, std::size_t n, const char* fmt, const Args&... args)
+		{
+			return log_every_n(LogLevels::debug, site, n, fmt, args...);
+		}
+		template <typename... Args>
+		inline detail::LineLogger Logger::info_every_n(LogSite &site, std::size_t n, const char* fmt, const Args&... args)
+		{
+			return log_every_n(LogLevels::info, site, n, fmt, args...);
+		}
+		template <typename... Args>
+		inline detail::LineLogger Logger::warn_every_n(LogSite &site, std::size_t n, const char* fmt, const Args&... args)
+		{
+			return log_every_n(LogLevels::warn, site, n, fmt, args...);
+		}
+		template <typename... Args>
+		inline detail::LineLogger Logger::error_every_n(LogSite &site, std::size_t n, const char* fmt, const Args&... args)
+		{
+			return log_every_n(LogLevels::error, site, n, fmt, args...);
+		}
+		template <typename... Args>
+		inline detail::LineLogger Logger::fatal_every_n(LogSite &site, std::size_t n, const char* fmt, const Args&... args)
+		{
+			return log_every_n(LogLevels::fatal, site, n, fmt, args...);
+		}
+		template <typename Rep, typename Period, typename... Args>
+		inline detail::LineLogger Logger::trace_every(LogSite &site, std::chrono::duration<Rep, Period> interval, const char* fmt, const Args&... args)
+		{
+			return log_every(LogLevels::trace, site, interval, fmt, args...);
+		}
+		template <typename Rep, typename Period, typename... Args>
+		inline detail::LineLogger Logger::debug_every(LogSite &site, std::chrono::duration<Rep, Period> interval, const char* fmt, const Args&... args)
+		{
+			return log_every(LogLevels::debug, site, interval, fmt, args...);
+		}
+		template <typename Rep, typename Period, typename... Args>
+		inline detail::LineLogger Logger::info_every(LogSite &site, std::chrono::duration<Rep, Period> interval, const char* fmt, const Args&... args)
+		{
+			return log_every(LogLevels::info, site, interval, fmt, args...);
+		}
+		template <typename Rep, typename Period, typename... Args>
+		inline detail::LineLogger Logger::warn_every(LogSite &site, std::chrono::duration<Rep, Period> interval, const char* fmt, const Args&... args)
+		{
+			return log_every(LogLevels::warn, site, interval, fmt, args...);
+		}
+		template <typename Rep, typename Period, typename... Args>
+		inline detail::LineLogger Logger::error_every(LogSite &site, std::chrono::duration<Rep, Period> interval, const char* fmt, const Args&... args)
+		{
+			return log_every(LogLevels::error, site, interval, fmt, args...);
+		}
+		template <typename Rep, typename Period, typename... Args>
+		inline detail::LineLogger Logger::fatal_every(LogSite &site, std::chrono::duration<Rep, Period> interval, const char* fmt, const Args&... args)
+		{
+			return log_every(LogLevels::fatal, site, interval, fmt, args...);
+		}
+		template <typename... Args>
+		inline detail::LineLogger Logger::trace_first_n(LogSite &site, std::size_t n, std::size_t thenEveryN, const char* fmt, const Args&... args)
+		{
+			return log_first_n(LogLevels::trace, site, n, thenEveryN, fmt, args...);
+		}
+		template <typename... Args>
+		inline detail::LineLogger Logger::debug_first_n(LogSite &site, std::size_t n, std::size_t thenEveryN, const char* fmt, const Args&... args)
+		{
+			return log_first_n(LogLevels::debug, site, n, thenEveryN, fmt, args...);
+		}
+		template <typename... Args>
+		inline detail::LineLogger Logger::info_first_n(LogSite &site, std::size_t n, std::size_t thenEveryN, const char* fmt, const Args&... args)
+		{
+			return log_first_n(LogLevels::info, site, n, thenEveryN, fmt, args...);
+		}
+		template <typename... Args>
+		inline detail::LineLogger Logger::warn_first_n(LogSite &site, std::size_t n, std::size_t thenEveryN, const char* fmt, const Args&... args)
+		{
+			return log_first_n(LogLevels::warn, site, n, thenEveryN, fmt, args...);
+		}
+		template <typename... Args>
+		inline detail::LineLogger Logger::error_first_n(LogSite &site, std::size_t n, std::size_t thenEveryN, const char* fmt, const Args&... args)
+		{
+			return log_first_n(LogLevels::error, site, n, thenEveryN, fmt, args...);
+		}
+		template <typename... Args>
+		inline detail::LineLogger Logger::fatal_first_n(LogSite &site, std::size_t n, std::size_t thenEveryN, const char* fmt, const Args&... args)
+		{
+			return log_first_n(LogLevels::fatal, site, n, thenEveryN, fmt, args...);
+		}
+
+
 		// logger.info(msg) << ".." call style
 		template <typename T>
 		inline detail::LineLogger Logger::trace(const T& msg)
@@ -4414,6 +6138,50 @@ namespace zz
 		 */
 		LoggerPtr get_logger(std::string name, bool createIfNotExists = true);
 
+		/*!
+		 * \brief Logger handle which caches the logger looked up by name.
+		 * Suitable as a static or member for loggers used at hot paths, e.g.
+		 * static log::LoggerHandle netLogger("net"); netLogger->info("connected");
+		 * The lookup is repeated only after loggers are dropped, so the handle follows
+		 * a logger recreated with the same name. Loggers it resolved before are kept alive
+		 * until the handle is destroyed, pointers returned by get() stay valid meanwhile.
+		 */
+		class LoggerHandle : private UnMovable
+		{
+		public:
+			explicit LoggerHandle(std::string name) : name_(name), logger_(nullptr), generation_(0) {}
+
+			Logger* get() const
+			{
+				Logger *logger = logger_.load(std::memory_order_acquire);
+				if (logger && generation_.load(std::memory_order_acquire) == detail::LoggerRegistry::instance().generation())
+				{
+					return logger;
+				}
+				return resolve();
+			}
+
+			Logger* operator->() const { return get(); }
+
+			Logger& operator*() const { return *get(); }
+
+			/*!
+			 * \brief Get name of the logger
+			 * \return Name of the logger
+			 */
+			const std::string& name() const { return name_; }
+
+		private:
+			Logger* resolve() const;
+
+			std::string					name_;
+			mutable std::mutex			mutex_;
+			mutable LoggerPtr			holder_;
+			mutable std::vector<LoggerPtr>	retired_;	//!< previous loggers, may still be used by other threads
+			mutable std::atomic<Logger*>	logger_;
+			mutable std::atomic<std::uint64_t>	generation_;
+		};
+
 		/*!
 		 * \brief Get the sink pointer to stdout
 		 * \return Shared pointer to stdout sink.
@@ -4436,8 +6204,9 @@ namespace zz
 		/*!
 		 * \brief Dump all loggers info.
 		 * \param out The stream where you want the info direct to, default std::cout
+		 * \param withStats Also dump counters and latency of loggers and sinks.
 		 */
-		void dump_loggers(std::ostream &out = std::cout);
+		void dump_loggers(std::ostream &out = std::cout, bool withStats = false);
 
 		/*!
 		 * \brief Create new ostream sink from existing ostream.
@@ -4452,18 +6221,113 @@ namespace zz
 		 * \brief Create new simple file sink withe filename provided.
 		 * \param filename
 		 * \param truncate Open the file in truncate mode?
+		 * \param bufferSize Lines are written in batches of this size in byte, 0 (default) to write each line directly.
+		 * Buffering is opt-in since pending lines are lost on crash, consts::kFileSinkBufferSize is a sensible size.
+		 * Error and fatal messages are always written and flushed immediately.
+		 * \param flushInterval Pending lines are flushed every interval in ms, 0 to disable.
 		 * \return Shared pointer to the new sink.
 		 */
-		SinkPtr new_simple_file_sink(std::string filename, bool truncate = false);
+		SinkPtr new_simple_file_sink(std::string filename, bool truncate = false,
+			std::size_t bufferSize = 0, int flushInterval = consts::kFileSinkFlushInterval);
 
 		/*!
 		 * \brief Create new rotate file sink.
 		 * \param filename
-		 * \param maxSizeInByte Maximum size in byte, sink will truncate the file and rewrite new content if exceed this size.
+		 * \param maxSizeInByte Maximum size in byte, sink will truncate the file and rewrite new content if exceed this size, 0 to disable.
 		 * \param backupOld Whether keep backups of the old files.
+		 * \param bufferSize Lines are written in batches of this size in byte, 0 (default) to write each line directly.
+		 * Buffering is opt-in since pending lines are lost on crash, consts::kFileSinkBufferSize is a sensible size.
+		 * Error and fatal messages are always written and flushed immediately.
+		 * \param flushInterval Pending lines are flushed every interval in ms, 0 to disable.
+		 * \param interval Also rotate hourly or daily.
+		 * \param maxBackups Maximum number of backups to keep, oldest ones are deleted, 0 for unlimited.
+		 * \param compressBackups Gzip backups in a low priority background thread.
 		 * \return Shared pointer to the new sink
 		 */
-		SinkPtr new_rotate_file_sink(std::string filename, std::size_t maxSizeInByte = 4194304, bool backupOld = false);
+		SinkPtr new_rotate_file_sink(std::string filename, std::size_t maxSizeInByte = consts::kRotateFileMaxSize, bool backupOld = false,
+			std::size_t bufferSize = 0, int flushInterval = consts::kFileSinkFlushInterval,
+			RotateInterval interval = RotateInterval::none, std::size_t maxBackups = 0, bool compressBackups = false);
+
+		/*!
+		 * \brief Create new null sink, which formats messages and discards them.
+		 * \param name
+		 * \return Shared pointer to the new sink.
+		 */
+		SinkPtr new_null_sink(std::string name);
+
+		/*!
+		 * \brief Create new memory sink, which keeps the last lines in memory, see read_memory_sink().
+		 * \param name
+		 * \param capacity Number of lines kept, rounded up to power of 2.
+		 * \param lineSize Maximum size of each line in byte, longer lines are truncated.
+		 * \return Shared pointer to the new sink.
+		 */
+		SinkPtr new_memory_sink(std::string name, std::size_t capacity = consts::kMemorySinkCapacity,
+			std::size_t lineSize = consts::kMemorySinkLineSize);
+
+		/*!
+		 * \brief Get lines kept by memory sink, also accepts async sink wrapping a memory sink.
+		 * \param sink
+		 * \return Rendered lines from oldest to newest
+		 */
+		std::vector<std::string> read_memory_sink(SinkPtr sink);
+
+		/*!
+		 * \brief Get lines kept by memory sink with the name given.
+		 * \param name
+		 * \return Rendered lines from oldest to newest
+		 */
+		std::vector<std::string> read_memory_sink(std::string name);
+
+		/*!
+		 * \brief Create new asynchronous sink wrapping an existing sink.
+		 * Messages are queued and written by a background worker thread,
+		 * pending messages are flushed when the async sink is destroyed.
+		 * \param sink The sink that actually writes messages, e.g. a file sink.
+		 * \param queueSize Size of message queue, must be power of 2.
+		 * \param policy What to do when the queue is full.
+		 * \param dropBelow Messages below this level are dropped on overflow, only for OverflowPolicy::drop_below_level.
+		 * \return Shared pointer to the new sink.
+		 */
+		SinkPtr new_async_sink(SinkPtr sink, std::size_t queueSize = consts::kAsyncQueueSize,
+			OverflowPolicy policy = OverflowPolicy::block, LogLevels dropBelow = LogLevels::warn);
+
+		/*!
+		 * \brief Create new binary file sink, which stores raw arguments and leaves formatting to decode_binary_log().
+		 * \param filename
+		 * \param truncate Open the file in truncate mode?
+		 * \return Shared pointer to the new sink.
+		 */
+		SinkPtr new_binary_file_sink(std::string filename, bool truncate = false);
+
+		/*!
+		 * \brief Create new ring file sink, a memory mapped file used as circular buffer for always-on logging.
+		 * Existing ring file with the same capacity is continued, otherwise it is reset.
+		 * \param filename
+		 * \param capacity Size of the ring in byte, oldest lines are overwritten when it is full.
+		 * \return Shared pointer to the new sink.
+		 */
+		SinkPtr new_ring_file_sink(std::string filename, std::size_t capacity = consts::kRingLogDefaultCapacity);
+
+		/*!
+		 * \brief Read ring file written by ring file sink, unwrap the circular buffer.
+		 * \param filename
+		 * \return Lines from oldest to newest, partially overwritten oldest line is skipped.
+		 */
+		std::string read_ring_log(std::string filename);
+
+		/*!
+		 * \brief Decode binary log written by binary file sink into text.
+		 * An incomplete record at the end, e.g. from a crashed process, is ignored.
+		 * \param in Binary input stream
+		 * \param out Text output stream
+		 * \param format Format used to render each message, same specifiers as sink format
+		 * \param datetimeFormat Datetime format used to render time stamps
+		 * \return Number of decoded messages
+		 */
+		std::size_t decode_binary_log(std::istream &in, std::ostream &out,
+			const std::string &format = consts::kDefaultLoggerFormat,
+			const std::string &datetimeFormat = consts::kDefaultLoggerDatetimeFormat);
 
 		/*!
 		 * \brief Lock all loggers.
@@ -4485,6 +6349,8 @@ namespace zz
 
 		/*!
 		 * \brief Delete all loggers.
+		 * Also stops the background flusher of buffered file sinks,
+		 * call it before exit if buffered sinks are used with VC12.
 		 */
 		void drop_all_loggers();
 
@@ -4527,6 +6393,88 @@ namespace zz
 		void config_from_stringstream(std::stringstream& ss);
 	} // namespace log
 
+	/*!
+	 * \brief Compile time log levels, used by ZUPPLY_LOG_ACTIVE_LEVEL.
+	 * Values are identical to zz::log::LogLevels.
+	 */
+#define ZUPPLY_LOG_LEVEL_TRACE 0
+#define ZUPPLY_LOG_LEVEL_DEBUG 1
+#define ZUPPLY_LOG_LEVEL_INFO 2
+#define ZUPPLY_LOG_LEVEL_WARN 3
+#define ZUPPLY_LOG_LEVEL_ERROR 4
+#define ZUPPLY_LOG_LEVEL_FATAL 5
+#define ZUPPLY_LOG_LEVEL_OFF 6
+
+	/*!
+	 * \brief Compile time threshold for ZZ_LOG_XXX macros, levels below it are compiled out.
+	 * Define it before including zupply.hpp, e.g. -DZUPPLY_LOG_ACTIVE_LEVEL=ZUPPLY_LOG_LEVEL_INFO
+	 */
+#ifndef ZUPPLY_LOG_ACTIVE_LEVEL
+#define ZUPPLY_LOG_ACTIVE_LEVEL ZUPPLY_LOG_LEVEL_TRACE
+#endif
+
+	// \cond
+	// arguments are evaluated only if the level is enabled, both call styles are supported:
+	// ZZ_LOG_INFO(logger, "value {}", v) and ZZ_LOG_INFO(logger, "value ") << v
+#define ZZ_LOG_IF_ENABLED_(logger, lvl, ...) \
+	if (!(logger)->should_log_counted(::zz::log::LogLevels::lvl)) {} else (logger)->lvl(__VA_ARGS__)
+	// stripped levels still type check but are never executed
+#define ZZ_LOG_DISABLED_(logger, lvl, ...) \
+	if (true) {} else (logger)->lvl(__VA_ARGS__)
+	// every expansion instantiates its own lambda, so its own static call site state
+#define ZZ_LOG_SITE_() \
+	([]() -> ::zz::log::LogSite& { static ::zz::log::LogSite site; return site; }())
+#define ZZ_LOG_SAMPLED_(logger, lvl, method, ...) \
+	if (::zz::log::LogLevels::lvl < ZUPPLY_LOG_ACTIVE_LEVEL) {} else (logger)->method(::zz::log::LogLevels::lvl, ZZ_LOG_SITE_(), __VA_ARGS__)
+	// \endcond
+
+	/*!
+	 * \brief Rate limited logging with state owned by the call site, lvl is the level name, e.g.
+	 * ZZ_LOG_EVERY_N(logger, info, 100, "value {}", v);
+	 * ZZ_LOG_EVERY(logger, warn, std::chrono::seconds(1), "queue full");
+	 * ZZ_LOG_FIRST_N(logger, error, 10, 1000, "failed {}", code);
+	 * Levels below ZUPPLY_LOG_ACTIVE_LEVEL are compiled out.
+	 */
+#define ZZ_LOG_EVERY_N(logger, lvl, n, ...) ZZ_LOG_SAMPLED_(logger, lvl, log_every_n, n, __VA_ARGS__)
+#define ZZ_LOG_EVERY(logger, lvl, interval, ...) ZZ_LOG_SAMPLED_(logger, lvl, log_every, interval, __VA_ARGS__)
+#define ZZ_LOG_FIRST_N(logger, lvl, n, thenEveryN, ...) ZZ_LOG_SAMPLED_(logger, lvl, log_first_n, n, thenEveryN, __VA_ARGS__)
+
+#if ZUPPLY_LOG_ACTIVE_LEVEL <= ZUPPLY_LOG_LEVEL_TRACE
+#define ZZ_LOG_TRACE(logger, ...) ZZ_LOG_IF_ENABLED_(logger, trace, __VA_ARGS__)
+#else
+#define ZZ_LOG_TRACE(logger, ...) ZZ_LOG_DISABLED_(logger, trace, __VA_ARGS__)
+#endif
+
+#if ZUPPLY_LOG_ACTIVE_LEVEL <= ZUPPLY_LOG_LEVEL_DEBUG
+#define ZZ_LOG_DEBUG(logger, ...) ZZ_LOG_IF_ENABLED_(logger, debug, __VA_ARGS__)
+#else
+#define ZZ_LOG_DEBUG(logger, ...) ZZ_LOG_DISABLED_(logger, debug, __VA_ARGS__)
+#endif
+
+#if ZUPPLY_LOG_ACTIVE_LEVEL <= ZUPPLY_LOG_LEVEL_INFO
+#define ZZ_LOG_INFO(logger, ...) ZZ_LOG_IF_ENABLED_(logger, info, __VA_ARGS__)
+#else
+#define ZZ_LOG_INFO(logger, ...) ZZ_LOG_DISABLED_(logger, info, __VA_ARGS__)
+#endif
+
+#if ZUPPLY_LOG_ACTIVE_LEVEL <= ZUPPLY_LOG_LEVEL_WARN
+#define ZZ_LOG_WARN(logger, ...) ZZ_LOG_IF_ENABLED_(logger, warn, __VA_ARGS__)
+#else
+#define ZZ_LOG_WARN(logger, ...) ZZ_LOG_DISABLED_(logger, warn, __VA_ARGS__)
+#endif
+
+#if ZUPPLY_LOG_ACTIVE_LEVEL <= ZUPPLY_LOG_LEVEL_ERROR
+#define ZZ_LOG_ERROR(logger, ...) ZZ_LOG_IF_ENABLED_(logger, error, __VA_ARGS__)
+#else
+#define ZZ_LOG_ERROR(logger, ...) ZZ_LOG_DISABLED_(logger, error, __VA_ARGS__)
+#endif
+
+#if ZUPPLY_LOG_ACTIVE_LEVEL <= ZUPPLY_LOG_LEVEL_FATAL
+#define ZZ_LOG_FATAL(logger, ...) ZZ_LOG_IF_ENABLED_(logger, fatal, __VA_ARGS__)
+#else
+#define ZZ_LOG_FATAL(logger, ...) ZZ_LOG_DISABLED_(logger, fatal, __VA_ARGS__)
+#endif
+
 	// \cond
 	/////////////// implementations ////////////////
 	/////////////// saturate_cast (used in image & signal processing) ///////////////////
@@ -5083,7 +7031,7 @@ namespace zz
 		////////////////////////////////// ImageBase /////////////////////////////////
 		template<typename _Tp> inline
 			ImageBase<_Tp>::ImageBase()
-			:rows_(0), cols_(0), channels_(0), data_(nullptr)
+			:rows_(0), cols_(0), channels_(0), offset_(0), step_(0), data_(nullptr)
 		{
 			}
 
@@ -5099,20 +7047,27 @@ namespace zz
 				rows_ = other.rows_;
 				cols_ = other.cols_;
 				channels_ = other.channels_;
+				offset_ = other.offset_;
+				step_ = other.step_;
 				data_ = other.data_;	// shallow copy
+				allocator_ = other.allocator_;
 			}
 
 		template<typename _Tp> template<typename _Tp2> inline
 			ImageBase<_Tp>::operator ImageBase<_Tp2>() const
 		{
-				ImageBase<_Tp2> tmp(rows_, cols_, channels_);
+				ImageBase<_Tp2> tmp;
+				tmp.set_allocator(allocator_);
+				tmp.create(rows_, cols_, channels_);
 				_Tp2* p = tmp.ptr(0);
-				_Tp* p_ = ptr(0);
-				for (long i = 0; i < rows_ * cols_ * channels_; ++i)
+				for (int r = 0; r < rows_; ++r)
 				{
-					*p = saturate_cast<_Tp>(*p_);
-					++p;
-					++p_;
+					const _Tp* p_ = ptr(r, 0, 0);
+					for (int i = 0; i < cols_ * channels_; ++i)
+					{
+						*p = saturate_cast<_Tp2>(p_[i]);
+						++p;
+					}
 				}
 				return tmp;
 			}
@@ -5123,7 +7078,10 @@ namespace zz
 				rows_ = other.rows_;
 				cols_ = other.cols_;
 				channels_ = other.channels_;
+				offset_ = other.offset_;
+				step_ = other.step_;
 				data_ = other.data_;	// shallow copy
+				allocator_ = other.allocator_;
 				other.release();
 			}
 
@@ -5134,13 +7092,40 @@ namespace zz
 			}
 
 		template<typename _Tp> inline
-			void ImageBase<_Tp>::create(int rows, int cols, int channels)
+			void ImageBase<_Tp>::create(int rows, int cols, int channels, int rowAlign)
 		{
 				assert(rows > 0 && cols > 0 && channels > 0);
+				assert(rowAlign >= 0 && (rowAlign & (rowAlign - 1)) == 0 && rowAlign % sizeof(_Tp) == 0 && "row alignment should be power of 2");
+				int step = cols * channels;
+				if (rowAlign > 0)
+				{
+					int n = rowAlign / static_cast<int>(sizeof(_Tp));
+					step = (step + n - 1) / n * n;
+				}
+				std::size_t alignment = (std::max)(consts::kImageAlignment, static_cast<std::size_t>(rowAlign));
+				std::size_t count = static_cast<std::size_t>(rows) * step;
+				std::size_t size = (sizeof(_Tp) * count + alignment - 1) / alignment * alignment;
+				ImageAllocatorPtr alloc = allocator_ ? allocator_ : ImageAllocator::default_allocator();
+				_Tp* p = static_cast<_Tp*>(alloc->allocate(size, alignment));
+				std::fill_n(p, count, _Tp());
+				data_.reset(p, [alloc, size, alignment](_Tp* q) { alloc->deallocate(q, size, alignment); });
 				rows_ = rows;
 				cols_ = cols;
 				channels_ = channels;
-				data_ = std::make_shared<std::vector<_Tp>>(rows * cols * channels);
+				offset_ = 0;
+				step_ = step;
+			}
+
+		template<typename _Tp> inline
+			void ImageBase<_Tp>::set_allocator(ImageAllocatorPtr allocator)
+		{
+				allocator_ = allocator;
+			}
+
+		template<typename _Tp> inline
+			ImageAllocatorPtr ImageBase<_Tp>::allocator() const
+		{
+				return allocator_;
 			}
 
 		template<typename _Tp> inline
@@ -5149,6 +7134,8 @@ namespace zz
 				rows_ = 0;
 				cols_ = 0;
 				channels_ = 0;
+				offset_ = 0;
+				step_ = 0;
 				data_ = nullptr;
 			}
 
@@ -5158,17 +7145,24 @@ namespace zz
 				rows_ = other.rows_;
 				cols_ = other.cols_;
 				channels_ = other.channels_;
+				offset_ = other.offset_;
+				step_ = other.step_;
 				data_ = other.data_;	// shallow copy
+				allocator_ = other.allocator_;
 				return *this;
 			}
 
 		template<typename _Tp> inline
 			ImageBase<_Tp>& ImageBase<_Tp>::operator= (ImageBase<_Tp>&& other)
 		{
+				if (this == &other) return *this;
 				rows_ = other.rows_;
 				cols_ = other.cols_;
 				channels_ = other.channels_;
+				offset_ = other.offset_;
+				step_ = other.step_;
 				data_ = other.data_;	// shallow copy
+				allocator_ = other.allocator_;
 				other.release();
 				return *this;
 			}
@@ -5177,18 +7171,71 @@ namespace zz
 			_Tp& ImageBase<_Tp>::operator() (int row, int col, int channel)
 		{
 				detach();
-				long pos = row * cols_ * channels_ + col * channels_ + channel;
-				range_check(row, col, channel);
-				return (*data_)[pos];
+				return pixel(row, col, channel);
 			}
 
 		template<typename _Tp> inline
 			const _Tp& ImageBase<_Tp>::operator() (int row, int col, int channel) const
+		{
+				return pixel(row, col, channel);
+			}
+
+		template<typename _Tp> inline
+			_Tp& ImageBase<_Tp>::pixel(int row, int col, int channel)
+		{
+				assert(data_ && row >= 0 && row < rows_ && col >= 0 && col < cols_ && channel >= 0 && channel < channels_ && "Access out of range!");
+				return data_.get()[offset_ + static_cast<long>(row) * step_ + col * channels_ + channel];
+			}
+
+		template<typename _Tp> inline
+			const _Tp& ImageBase<_Tp>::pixel(int row, int col, int channel) const
+		{
+				assert(data_ && row >= 0 && row < rows_ && col >= 0 && col < cols_ && channel >= 0 && channel < channels_ && "Access out of range!");
+				return data_.get()[offset_ + static_cast<long>(row) * step_ + col * channels_ + channel];
+			}
+
+		template<typename _Tp> inline
+			void ImageBase<_Tp>::ensure_unique()
 		{
 				detach();
-				long pos = row * cols_ * channels_ + col * channels_ + channel;
-				range_check(row, col, channel);
-				return (*data_)[pos];
+			}
+
+		template<typename _Tp> inline
+			_Tp* ImageBase<_Tp>::row_ptr(int row)
+		{
+				assert(data_ && row >= 0 && row < rows_ && "Access out of range!");
+				return data_.get() + offset_ + static_cast<long>(row) * step_;
+			}
+
+		template<typename _Tp> inline
+			const _Tp* ImageBase<_Tp>::row_ptr(int row) const
+		{
+				assert(data_ && row >= 0 && row < rows_ && "Access out of range!");
+				return data_.get() + offset_ + static_cast<long>(row) * step_;
+			}
+
+		template<typename _Tp> inline
+			typename ImageBase<_Tp>::row_iterator ImageBase<_Tp>::row_begin(int row)
+		{
+				return row_ptr(row);
+			}
+
+		template<typename _Tp> inline
+			typename ImageBase<_Tp>::row_iterator ImageBase<_Tp>::row_end(int row)
+		{
+				return row_ptr(row) + cols_ * channels_;
+			}
+
+		template<typename _Tp> inline
+			typename ImageBase<_Tp>::const_row_iterator ImageBase<_Tp>::row_begin(int row) const
+		{
+				return row_ptr(row);
+			}
+
+		template<typename _Tp> inline
+			typename ImageBase<_Tp>::const_row_iterator ImageBase<_Tp>::row_end(int row) const
+		{
+				return row_ptr(row) + cols_ * channels_;
 			}
 
 		template<typename _Tp> inline
@@ -5215,12 +7262,24 @@ namespace zz
 				return channels_;
 			}
 
+		template<typename _Tp> inline
+			int ImageBase<_Tp>::step() const
+		{
+				return step_;
+			}
+
+		template<typename _Tp> inline
+			bool ImageBase<_Tp>::is_continuous() const
+		{
+				return step_ == cols_ * channels_;
+			}
+
 		template<typename _Tp> inline
 			void ImageBase<_Tp>::range_check(long long pos) const
 		{
 				assert(pos >= 0);
 				if (empty()) throw RuntimeException("Accessing emtpy image!");
-				if (pos >= rows_ * cols_ * channels_) throw RuntimeException("Access out of range!");
+				if (pos >= static_cast<long long>(rows_ - 1) * step_ + cols_ * channels_) throw RuntimeException("Access out of range!");
 			}
 
 		template<typename _Tp> inline
@@ -5235,23 +7294,23 @@ namespace zz
 			_Tp ImageBase<_Tp>::at(int row, int col, int channel) const
 		{
 				range_check(row, col, channel);
-				long pos = row * cols_ * channels_ + col * channels_ + channel;
-				return (*data_)[pos];
+				long pos = offset_ + static_cast<long>(row) * step_ + col * channels_ + channel;
+				return data_.get()[pos];
 			}
 
 		template<typename _Tp> inline
 			_Tp* ImageBase<_Tp>::ptr(int offset) const
 		{
 				range_check(offset);
-				return (*data_).data() + offset;
+				return data_.get() + offset_ + offset;
 			}
 
 		template<typename _Tp> inline
 			_Tp* ImageBase<_Tp>::ptr(int row, int col, int channel) const
 		{
 				range_check(row, col, channel);
-				long pos = row * cols_ * channels_ + col * channels_ + channel;
-				return (*data_).data() + pos;
+				long pos = offset_ + static_cast<long>(row) * step_ + col * channels_ + channel;
+				return data_.get() + pos;
 			}
 
 		template<typename _Tp> inline
@@ -5259,7 +7318,7 @@ namespace zz
 		{
 				assert(rows > 0 && cols > 0 && channels > 0 && "import size should be positive");
 				create(rows, cols, channels);
-				std::memcpy((*data_).data(), data, sizeof(_Tp)* rows * cols * channels);
+				std::memcpy(data_.get(), data, sizeof(_Tp)* rows * cols * channels);
 			}
 
 		template<typename _Tp> inline
@@ -5267,13 +7326,14 @@ namespace zz
 		{
 				assert(rows > 0 && cols > 0 && channels > 0 && data.size() >= rows * cols * channels);
 				create(rows, cols, channels);
-				std::memcpy((*data_).data(), data.data(), sizeof(_Tp)* rows * cols * channels);
+				std::memcpy(data_.get(), data.data(), sizeof(_Tp)* rows * cols * channels);
 			}
 
 		template<typename _Tp> inline
 			std::vector<_Tp> ImageBase<_Tp>::export_raw() const
 		{
-				return (*data_);
+				std::vector<_Tp> out;
+				return export_raw(out);
 			}
 
 		template<typename _Tp> template<typename _Tp2> inline
@@ -5281,42 +7341,62 @@ namespace zz
 		{
 				out.resize(rows_ * cols_ * channels_);
 				auto p = out.begin();
-				for (auto i = (*data_).begin(); i != (*data_).end(); ++i, ++p)
+				for (int r = 0; r < rows_; ++r)
 				{
-					*p = saturate_cast<_Tp2>(*i);
+					const _Tp* row = data_.get() + offset_ + static_cast<long>(r) * step_;
+					for (int i = 0; i < cols_ * channels_; ++i, ++p)
+					{
+						*p = saturate_cast<_Tp2>(row[i]);
+					}
 				}
 				return out;
 			}
 
 		template<typename _Tp> inline
-			void ImageBase<_Tp>::crop(int r0, int c0, int r1, int c1)
+			ImageBase<_Tp> ImageBase<_Tp>::roi(int r0, int c0, int r1, int c1) const
 		{
-				assert(r0 >= 0 && c0 >= 0 && r1 >= 0 && c1 >= 0 && "crop region should be positive!");
-				assert(r0 < rows_ && r1 < rows_ && c0 < cols_ && c1 < cols_ && "crop point should in image!");
-				assert(r0 != r1 && (c0 != c1) && "need a rectangle region!");
+				if (empty()) throw RuntimeException("Accessing emtpy image!");
+				if (r0 < 0 || c0 < 0 || r1 < 0 || c1 < 0 || r0 > rows_ || r1 > rows_ || c0 > cols_ || c1 > cols_)
+				{
+					throw RuntimeException("roi point out of range!");
+				}
+				if (r0 == r1 || c0 == c1) throw RuntimeException("roi needs a rectangle region!");
 
-				int width = std::abs(c0 - c1);
-				int height = std::abs(r0 - r1);
 				int i0 = (std::min)(r0, r1);
-				int i1 = (std::max)(r0, r1);
 				int j0 = (std::min)(c0, c1);
-				int j1 = (std::max)(c0, c1);
-				detach();
-				ImageBase<_Tp> tmp(height, width, channels_);
-
-				// temporary solution, not optimized
-				_Tp* pOld = ptr(i0, j0, 0);
-				_Tp* pNew = tmp.ptr(0);
-				int step = cols_ * channels_;
-				int bulkSize = width * channels_;
-				for (auto r = 0; r < height; ++r)
+				ImageBase<_Tp> view(*this);
+				view.rows_ = std::abs(r0 - r1);
+				view.cols_ = std::abs(c0 - c1);
+				view.offset_ = offset_ + static_cast<long>(i0) * step_ + j0 * channels_;
+				return view;
+			}
+
+		template<typename _Tp> inline
+			ImageBase<_Tp> ImageBase<_Tp>::roi(Rect rect) const
+		{
+				return roi(rect.y, rect.x, rect.y + rect.height, rect.x + rect.width);
+			}
+
+		template<typename _Tp> inline
+			ImageBase<_Tp> ImageBase<_Tp>::clone() const
+		{
+				ImageBase<_Tp> tmp;
+				tmp.allocator_ = allocator_;
+				if (empty()) return tmp;
+				tmp.create(rows_, cols_, channels_);
+				int bulkSize = cols_ * channels_;
+				for (int r = 0; r < rows_; ++r)
 				{
 					// copy entire row
-					std::memcpy(pNew, pOld, sizeof(_Tp)* bulkSize);
-					pOld += step;
-					pNew += bulkSize;
+					std::memcpy(tmp.ptr(r, 0, 0), ptr(r, 0, 0), sizeof(_Tp)* bulkSize);
 				}
-				std::swap(*this, tmp);
+				return tmp;
+			}
+
+		template<typename _Tp> inline
+			void ImageBase<_Tp>::crop(int r0, int c0, int r1, int c1)
+		{
+				*this = roi(r0, c0, r1, c1);
 			}
 
 		template<typename _Tp> inline
@@ -5328,17 +7408,15 @@ namespace zz
 		template<typename _Tp> inline
 			void ImageBase<_Tp>::crop(Rect rect)
 		{
-				crop(rect.y, rect.x, rect.y + rect.height, rect.y + rect.width);
+				*this = roi(rect);
 			}
 
 		template<typename _Tp> inline
 			void ImageBase<_Tp>::detach()
 		{
 				if (data_.use_count() < 2) return;
-				// detach the current resource from shared
-				std::shared_ptr<std::vector<_Tp>> tmp = std::make_shared<std::vector<_Tp>>();
-				*tmp = *data_; // deep copy
-				data_ = tmp;
+				// detach the current resource from shared, views are materialized
+				*this = clone();
 			}
 	} // namespace zz::detail
 
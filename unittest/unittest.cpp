@@ -627,6 +627,18 @@ TEST_CASE("arg-argParser", "arg-parser")
 	CHECK(d == Approx(-0.5));
 }
 
+TEST_CASE("positional-argParser", "arg-parser")
+{
+	cfg::ArgParser p;
+	std::string input;
+	p.add_opt_value(-1, "", input, std::string(), "input file", "file").require();
+	int argc = 2;
+	char* argv[] = { (char*)"unittest", (char*)"in.txt" };
+	p.parse(argc, argv, false);
+	CHECK(p.count_error() == 0);
+	CHECK(input == "in.txt");
+}
+
 TEST_CASE("multi-arg-argParser", "multi-arg-parser")
 {
 	cfg::ArgParser p;
@@ -721,6 +733,601 @@ TEST_CASE("logger", "logger")
 	CHECK(fs::get_file_size(fn1) == fs::get_file_size(fn2));
 }
 
+namespace
+{
+	// logs to another logger from inside sink_it, like sinks reporting their own errors
+	class ReentrantSink : public log::detail::Sink
+	{
+	public:
+		explicit ReentrantSink(log::LoggerPtr inner) : inner_(inner) {}
+		void sink_it(const std::string &finalMsg, log::LogLevels) override
+		{
+			inner_->info("nested");
+			lines_.push_back(finalMsg);
+		}
+		void flush() override {}
+		std::string name() const override { return "reentrant"; }
+		std::string to_string() const override { return name(); }
+
+		std::vector<std::string> lines_;
+
+	private:
+		log::LoggerPtr inner_;
+	};
+}
+
+TEST_CASE("sink format", "logger")
+{
+	std::stringstream oss;
+	auto fmtLogger = std::make_shared<log::Logger>("fmt", log::level_mask_from_string("info"));
+	auto sink = log::new_ostream_sink(oss, "format_stream");
+	sink->set_format("[%logger][%lvl|%level] %%msg %msg");
+	fmtLogger->attach_sink(sink);
+	fmtLogger->info("hello {}", 1);
+	fmtLogger->info("world\n");
+	CHECK(oss.str() == "[fmt][I|INFO] %msg hello 1" + os::endl() + "[fmt][I|INFO] %msg world\n");
+
+	// cached datetime rendering
+	auto tp = std::chrono::system_clock::from_time_t(1500000000) + std::chrono::milliseconds(42);
+	std::string year = std::to_string(os::localtime(1500000000).tm_year + 1900);
+	std::string out;
+	log::detail::render_datetime("%Y|%frac|%frac", tp, out);
+	CHECK(out == year + "|042|042");
+	out.clear();
+	log::detail::render_datetime("%Y|%frac|%frac", tp + std::chrono::milliseconds(7), out);
+	CHECK(out == year + "|049|049");
+
+	// fast path value formatting matches iostreams
+	out.clear();
+	log::detail::append_value(out, -42);
+	log::detail::append_value(out, ' ');
+	log::detail::append_value(out, 18446744073709551615ULL);
+	log::detail::append_value(out, 0.1f);
+	log::detail::append_value(out, 1e20);
+	log::detail::append_value(out, true);
+	std::ostringstream ref;
+	ref << -42 << ' ' << 18446744073709551615ULL << 0.1f << 1e20 << true;
+	CHECK(out == ref.str());
+	oss.str("");
+	fmtLogger->info("%{} {} {}", 1, 2.5, "x");
+	fmtLogger->info() << "stream " << 3 << ' ' << std::string("y");
+	CHECK(oss.str() == "[fmt][I|INFO] %msg {} 1 2.5" + os::endl() + "[fmt][I|INFO] %msg stream 3 y" + os::endl());
+
+	// sinks sharing a format reuse the text, nested logging does not clobber it
+	std::stringstream innerOss;
+	auto inner = std::make_shared<log::Logger>("inner", log::level_mask_from_string("info"));
+	auto innerSink = log::new_ostream_sink(innerOss, "inner_stream");
+	innerSink->set_format("%msg");
+	inner->attach_sink(innerSink);
+	auto reentrant = std::make_shared<ReentrantSink>(inner);
+	reentrant->set_format("%msg");
+	oss.str("");
+	sink->set_format("%msg");
+	fmtLogger->attach_sink(reentrant);
+	fmtLogger->info("outer {}", 1);
+	fmtLogger->info("outer {}", 2);
+	REQUIRE(reentrant->lines_.size() == 2);
+	CHECK(reentrant->lines_[0] == "outer 1" + os::endl());
+	CHECK(reentrant->lines_[1] == "outer 2" + os::endl());
+	CHECK(oss.str() == "outer 1" + os::endl() + "outer 2" + os::endl());
+	CHECK(innerOss.str() == "nested" + os::endl() + "nested" + os::endl());
+	fmtLogger->detach_all_sinks();
+}
+
+TEST_CASE("log macros", "logger")
+{
+	std::stringstream oss;
+	auto macroLogger = std::make_shared<log::Logger>("macro", log::level_mask_from_string("info"));
+	auto sink = log::new_ostream_sink(oss, "macro_stream");
+	sink->set_format("%msg");
+	macroLogger->attach_sink(sink);
+	int evaluated = 0;
+	auto count = [&evaluated]() { return ++evaluated; };
+	ZZ_LOG_DEBUG(macroLogger, "skipped {}", count());
+	ZZ_LOG_TRACE(macroLogger, "skipped ") << count();
+	CHECK(evaluated == 0);
+	ZZ_LOG_INFO(macroLogger, "logged {}", count());
+	ZZ_LOG_INFO(macroLogger, "logged ") << count();
+	CHECK(evaluated == 2);
+	CHECK(oss.str() == "logged 1" + os::endl() + "logged 2" + os::endl());
+}
+
+TEST_CASE("rate limited logging", "logger")
+{
+	std::stringstream oss;
+	auto rateLogger = std::make_shared<log::Logger>("rate", log::level_mask_from_string("info"));
+	auto sink = log::new_ostream_sink(oss, "rate_stream");
+	sink->set_format("%msg");
+	rateLogger->attach_sink(sink);
+	std::string nl = os::endl();
+
+	for (int i = 0; i < 7; ++i) ZZ_LOG_EVERY_N(rateLogger, info, 3, "every_n {}", i);
+	CHECK(oss.str() == "every_n 0" + nl + "suppressed 2 similar messages" + nl + "every_n 3" + nl
+		+ "suppressed 2 similar messages" + nl + "every_n 6" + nl);
+
+	oss.str("");
+	for (int i = 0; i < 8; ++i) ZZ_LOG_FIRST_N(rateLogger, info, 2, 3, "first_n {}", i);
+	CHECK(oss.str() == "first_n 0" + nl + "first_n 1" + nl + "suppressed 2 similar messages" + nl + "first_n 4" + nl
+		+ "suppressed 2 similar messages" + nl + "first_n 7" + nl);
+
+	oss.str("");
+	for (int i = 0; i < 5; ++i) ZZ_LOG_EVERY(rateLogger, info, std::chrono::hours(1), "every {}", i);
+	CHECK(oss.str() == "every 0" + nl);
+
+	// identical format strings at different call sites keep separate budgets
+	oss.str("");
+	ZZ_LOG_EVERY(rateLogger, info, std::chrono::hours(1), "same");
+	ZZ_LOG_EVERY(rateLogger, info, std::chrono::hours(1), "same");
+	CHECK(oss.str() == "same" + nl + "same" + nl);
+
+	// explicit site owned by the caller
+	oss.str("");
+	log::LogSite site;
+	for (int i = 0; i < 4; ++i) rateLogger->info_every_n(site, 2, "site {}", i) << "!";
+	CHECK(oss.str() == "site 0!" + nl + "suppressed 1 similar messages" + nl + "site 2!" + nl);
+
+	// disabled levels do not count
+	oss.str("");
+	for (int i = 0; i < 5; ++i) ZZ_LOG_EVERY_N(rateLogger, debug, 2, "debug every_n {}", i);
+	CHECK(oss.str().empty());
+}
+
+TEST_CASE("logger stats", "logger")
+{
+	log::LatencyHistogram hist;
+	for (std::uint64_t i = 1; i <= 1000; ++i) hist.record(i);
+	CHECK(hist.count() == 1000);
+	CHECK(hist.max() == 1000);
+	CHECK(hist.mean() == Approx(500.5));
+	CHECK(hist.percentile(50) >= 500);
+	CHECK(hist.percentile(50) <= 500 + 500 / 16);
+	CHECK(hist.percentile(100) == 1000);
+
+	std::stringstream oss;
+	auto statsLogger = std::make_shared<log::Logger>("stats", log::level_mask_from_string("info"));
+	auto sink = log::new_ostream_sink(oss, "stats_stream");
+	sink->set_format("%msg");
+	sink->set_level_mask(log::level_mask_from_string("info"));
+	statsLogger->attach_sink(sink);
+	log::LogConfig::instance().set_latency_stats(true);
+	for (int i = 0; i < 10; ++i)
+	{
+		statsLogger->info("stats {}", i);
+		statsLogger->debug("filtered {}", i);
+	}
+	log::LogConfig::instance().set_latency_stats(false);
+	statsLogger->info("not timed");
+	CHECK(statsLogger->stats().accepted_ == 11);
+	CHECK(statsLogger->stats().filtered_ == 10);
+	CHECK(statsLogger->stats().latency_.count() == 10);
+	CHECK(sink->stats().accepted_ == 11);
+	CHECK(sink->stats().bytes_ == oss.str().size());
+	CHECK(sink->stats().latency_.count() == 10);
+	CHECK(statsLogger->to_string(true).find("accepted: 11") != std::string::npos);
+	// macros count filtered levels too
+	ZZ_LOG_DEBUG(statsLogger, "filtered by macro");
+	CHECK(statsLogger->stats().filtered_ == 11);
+	sink->stats().reset();
+	CHECK(sink->stats().accepted_ == 0);
+	CHECK(sink->stats().latency_.count() == 0);
+}
+
+TEST_CASE("null and memory sink", "logger")
+{
+	auto memLogger = std::make_shared<log::Logger>("memory", log::level_mask_from_string("info"));
+	auto nullSink = log::new_null_sink("test_null");
+	auto memSink = log::new_memory_sink("test_memory", 3, 8);
+	memSink->set_format("%msg");
+	memLogger->attach_sink(nullSink);
+	memLogger->attach_sink(memSink);
+	for (int i = 0; i < 6; ++i) memLogger->info("line {}", i);
+	memLogger->info("a long line truncated");
+	CHECK(nullSink->stats().accepted_ == 7);
+
+	// capacity rounded up to 4 lines
+	auto lines = log::read_memory_sink(memSink);
+	REQUIRE(lines.size() == 4);
+	CHECK(lines[0] == "line 3" + os::endl());
+	CHECK(lines[2] == "line 5" + os::endl());
+	CHECK(lines[3] == "a long l");
+	CHECK_THROWS_AS(log::read_memory_sink(nullSink), ArgException);
+
+	// concurrent writers and reader
+	std::atomic_bool done(false);
+	std::atomic<int> torn(0);
+	std::thread reader([&]()
+	{
+		while (!done)
+		{
+			for (auto &line : log::read_memory_sink(memSink))
+			{
+				if (line != "a long l" && !fmt::ends_with(line, os::endl())) ++torn;
+			}
+		}
+	});
+	std::vector<std::thread> writers;
+	for (int t = 0; t < 4; ++t)
+	{
+		writers.push_back(std::thread([&memLogger, t]()
+		{
+			for (int i = 0; i < 1000; ++i) memLogger->info("t{} {}", t, i);
+		}));
+	}
+	for (auto &w : writers) w.join();
+	done = true;
+	reader.join();
+	CHECK(torn == 0);
+	CHECK(memSink->stats().accepted_ + memSink->stats().dropped_ == 4007);
+
+	// from config
+	std::stringstream ss;
+	ss << "[sinks]\nmemcfg.type = memory\nmemcfg.capacity = 2\nmemcfg.line_size = 4\nmemcfg.format = %msg\n"
+		<< "[loggers]\nmemorycfg.sink_list = memcfg\nmemorycfg.levels = info\n";
+	log::config_from_stringstream(ss);
+	auto cfgLogger = log::get_logger("memorycfg");
+	for (int i = 0; i < 3; ++i) cfgLogger->info("cfg {}", i);
+	auto cfgLines = log::read_memory_sink(log::get_sink("memcfg"));
+	REQUIRE(cfgLines.size() == 2);
+	CHECK(cfgLines[1] == "cfg ");
+}
+
+TEST_CASE("structured fields", "logger")
+{
+	std::stringstream oss;
+	std::stringstream jss;
+	auto fieldLogger = std::make_shared<log::Logger>("fields", log::level_mask_from_string("info"));
+	auto textSink = log::new_ostream_sink(oss, "fields_text");
+	textSink->set_format("%msg %fields");
+	auto jsonSink = log::new_ostream_sink(jss, "fields_json");
+	jsonSink->set_format("%json");
+	fieldLogger->attach_sink(textSink);
+	fieldLogger->attach_sink(jsonSink);
+	fieldLogger->info("request {}", 1).with("user", "bob \"b\"").with("latency_us", 25).with("ok", true).with("ratio", 0.5);
+	fieldLogger->debug("filtered").with("user", "x");
+	fieldLogger->info() << "plain";
+	CHECK(oss.str() == "request 1 user=bob \"b\" latency_us=25 ok=1 ratio=0.5" + os::endl() + "plain " + os::endl());
+	std::string json = jss.str();
+	auto first = json.substr(0, json.find(os::endl()));
+	CHECK(fmt::starts_with(first, "{\"time\":\""));
+	CHECK(fmt::ends_with(first, ",\"level\":\"INFO\",\"logger\":\"fields\",\"thread\":" + std::to_string(os::thread_id())
+		+ ",\"msg\":\"request 1\",\"fields\":{\"user\":\"bob \\\"b\\\"\",\"latency_us\":25,\"ok\":true,\"ratio\":0.5}}"));
+	CHECK(fmt::ends_with(json, ",\"msg\":\"plain\"}" + os::endl()));
+	// fields named like fixed keys do not duplicate them
+	jss.str("");
+	fieldLogger->info("keyed").with("msg", "field");
+	CHECK(fmt::ends_with(jss.str(), ",\"msg\":\"keyed\",\"fields\":{\"msg\":\"field\"}}" + os::endl()));
+}
+
+TEST_CASE("logger registry", "logger")
+{
+	std::vector<log::LoggerPtr> found(8);
+	std::vector<std::thread> vt;
+	for (int i = 0; i < 8; ++i)
+	{
+		vt.push_back(std::thread([&found, i]() { found[i] = log::get_logger("registry_race"); }));
+	}
+	for (auto &t : vt) t.join();
+	for (auto &logger : found) CHECK(logger == found[0]);
+
+	log::LoggerHandle handle("registry_handle");
+	auto original = log::get_logger("registry_handle");
+	log::Logger *cached = handle.get();
+	CHECK(cached == original.get());
+	log::drop_logger("registry_handle");
+	CHECK(!log::get_logger("registry_handle", false));
+	// handle follows the logger recreated with the same name
+	auto recreated = log::get_logger("registry_handle");
+	CHECK(handle.get() == recreated.get());
+	handle->debug("new logger");
+	// the previous logger stays alive while the handle exists
+	original.reset();
+	CHECK(cached->name() == "registry_handle");
+	log::drop_logger("registry_handle");
+	log::drop_logger("registry_race");
+}
+
+TEST_CASE("thread name", "logger")
+{
+	std::stringstream oss;
+	auto threadLogger = std::make_shared<log::Logger>("thread_name", log::level_mask_from_string("info"));
+	auto sink = log::new_ostream_sink(oss, "thread_name_stream");
+	sink->set_format("%thread %msg");
+	threadLogger->attach_sink(sink);
+	std::size_t id = 0;
+	std::thread t([&]()
+	{
+		id = os::thread_id();
+		CHECK(os::thread_id() == id);
+		CHECK(os::thread_name().empty());
+		threadLogger->info("unnamed");
+		os::set_thread_name("worker_1");
+		CHECK(os::thread_name() == "worker_1");
+		threadLogger->info("named");
+	});
+	t.join();
+	CHECK(id != os::thread_id());
+	CHECK(oss.str() == std::to_string(id) + " unnamed" + os::endl() + "worker_1 named" + os::endl());
+}
+
+TEST_CASE("binary logger", "logger")
+{
+	const char* fn = "test_binary.zzl";
+	REQUIRE(os::remove_all(fn));
+	std::stringstream oss;
+	auto binLogger = std::make_shared<log::Logger>("binary", log::level_mask_from_string("info warn"));
+	auto sink = log::new_binary_file_sink(fn, true);
+	auto textSink = log::new_ostream_sink(oss, "binary_stream");
+	textSink->set_format("%msg");
+	binLogger->attach_sink(sink);
+	binLogger->info("int {} float {} str {} char {}", -7, 2.5, "abc", 'x');
+	binLogger->warn("escaped %{} {}", std::string("s")) << " tail";
+	binLogger->info() << "stream " << 42;
+	{
+		// text sink attached while a line is in flight still gets rendered text
+		auto line = binLogger->info("late {}", 3);
+		binLogger->attach_sink(textSink);
+	}
+	binLogger->info("both {}", 1u);
+	sink->flush();
+	CHECK(oss.str() == "late 3" + os::endl() + "both 1" + os::endl());
+	CHECK_THROWS_AS(sink->set_format("%msg"), ArgException);
+
+	std::ifstream in(fn, std::ios::in | std::ios::binary);
+	std::stringstream out;
+	CHECK(log::decode_binary_log(in, out, "[%logger][%level] %msg") == 5);
+	CHECK(out.str() == "[binary][INFO] int -7 float 2.5 str abc char x" + os::endl()
+		+ "[binary][WARN] escaped {} s tail" + os::endl()
+		+ "[binary][INFO] stream 42" + os::endl()
+		+ "[binary][INFO] late 3" + os::endl()
+		+ "[binary][INFO] both 1" + os::endl());
+}
+
+TEST_CASE("ring logger", "logger")
+{
+	const char* fn = "test_ring.log";
+	REQUIRE(os::remove_all(fn));
+	{
+		auto ringLogger = std::make_shared<log::Logger>("ring", log::level_mask_from_string("info"));
+		auto sink = log::new_ring_file_sink(fn, 64);
+		sink->set_format("%msg");
+		ringLogger->attach_sink(sink);
+		ringLogger->info("first line");
+		CHECK(log::read_ring_log(fn) == "first line" + os::endl());
+		for (int i = 0; i < 20; ++i) ringLogger->info("line {}", i);
+	}
+	// wrapped, oldest partial line dropped
+	std::string nl = os::endl();
+	std::string expect;
+	for (int i = 19; expect.size() + 7 + nl.size() <= 64 && i >= 0; --i)
+	{
+		expect = "line " + std::to_string(i) + nl + expect;
+	}
+	std::string text = log::read_ring_log(fn);
+	CHECK(text.size() <= 64);
+	CHECK(text == expect.substr(expect.size() - text.size()));
+	CHECK(text.substr(text.size() - 7 - nl.size()) == "line 19" + nl);
+
+	// continue existing ring
+	{
+		auto ringLogger = std::make_shared<log::Logger>("ring2", log::level_mask_from_string("info"));
+		auto sink = log::new_ring_file_sink(fn, 64);
+		sink->set_format("%msg");
+		ringLogger->attach_sink(sink);
+		ringLogger->info("after");
+	}
+	text = log::read_ring_log(fn);
+	CHECK(text.substr(text.size() - 12 - 2 * nl.size()) == "line 19" + nl + "after" + nl);
+}
+
+TEST_CASE("buffered file sink", "logger")
+{
+	const char* fn = "test_buffered.log";
+	REQUIRE(os::remove_all(fn));
+	auto bufLogger = std::make_shared<log::Logger>("buffered", log::level_mask_from_string("info error"));
+	auto sink = log::new_simple_file_sink(fn, true, 4096, 50);
+	sink->set_format("%msg");
+	bufLogger->attach_sink(sink);
+	bufLogger->info("pending");
+	CHECK(fs::get_file_size(fn) == 0);
+	// errors are written immediately along with pending lines
+	bufLogger->error("urgent");
+	CHECK(fs::get_file_size(fn) == 13 + 2 * os::endl().size());
+	// flushed by interval
+	bufLogger->info("later");
+	time::sleep(300);
+	CHECK(fs::get_file_size(fn) == 18 + 3 * os::endl().size());
+	// flusher can be stopped explicitly and resumes with the next buffered sink
+	log::detail::SinkFlusher::instance().stop();
+	bufLogger->info("stopped");
+	time::sleep(200);
+	CHECK(fs::get_file_size(fn) == 18 + 3 * os::endl().size());
+	log::detail::SinkFlusher::instance().add(log::new_null_sink("flusher_restart"), 50);
+	time::sleep(300);
+	CHECK(fs::get_file_size(fn) == 25 + 4 * os::endl().size());
+	bufLogger->detach_all_sinks();
+}
+
+TEST_CASE("rotate file sink", "logger")
+{
+	std::string dir = "test_rotate_dir";
+	os::remove_dir(dir);
+	REQUIRE(os::create_directory(dir));
+	std::string fn = os::path_join({ dir, "rotate.log" });
+	{
+		auto rotLogger = std::make_shared<log::Logger>("rotate", log::level_mask_from_string("info"));
+		auto sink = log::new_rotate_file_sink(fn, 100, true, 0, 0, log::RotateInterval::none, 2);
+		sink->set_format("%msg");
+		rotLogger->attach_sink(sink);
+		for (int i = 0; i < 40; ++i)
+		{
+			rotLogger->info("rotate line {}", i);
+			// distinct backup names
+			if (i % 3 == 2) time::sleep(2);
+		}
+		std::dynamic_pointer_cast<log::detail::RotateFileSink>(sink)->wait_rotation();
+		CHECK(os::is_file(fn + log::consts::kRotateNextFileSuffix));
+	}
+	auto files = os::list_directory(dir);
+	CHECK(files.size() == 3);
+	std::ifstream in(fn);
+	std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	in.close();
+	CHECK(fmt::ends_with(content, "rotate line 39" + os::endl()));
+	os::remove_dir(dir);
+}
+
+TEST_CASE("rotate file sink compression", "logger")
+{
+	std::string dir = "test_rotate_gz_dir";
+	os::remove_dir(dir);
+	REQUIRE(os::create_directory(dir));
+	std::string fn = os::path_join({ dir, "rotate.log" });
+	{
+		auto rotLogger = std::make_shared<log::Logger>("rotate_gz", log::level_mask_from_string("info"));
+		auto sink = log::new_rotate_file_sink(fn, 100, true, 0, 0, log::RotateInterval::none, 0, true);
+		sink->set_format("%msg");
+		rotLogger->attach_sink(sink);
+		for (int i = 0; i < 12; ++i)
+		{
+			rotLogger->info("rotate line {}", i);
+			if (i % 3 == 2) time::sleep(2);
+		}
+	}
+	// pending compressions are finished when sink is destroyed
+	std::vector<std::string> backups;
+	for (auto &path : os::list_directory(dir))
+	{
+		if (path == os::absolute_path(fn)) continue;
+		REQUIRE(fmt::ends_with(path, log::consts::kRotateCompressSuffix));
+		backups.push_back(path);
+	}
+	REQUIRE(backups.size() > 0);
+	std::sort(backups.begin(), backups.end());
+	std::string all;
+	for (auto &path : backups)
+	{
+		std::string content;
+		REQUIRE(log::detail::gunzip_file(path, content));
+		all += content;
+	}
+	std::ifstream in(fn, std::ios::binary);
+	all.append((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	in.close();
+	std::string expected;
+	for (int i = 0; i < 12; ++i) expected += "rotate line " + std::to_string(i) + os::endl();
+	CHECK(all == expected);
+	os::remove_dir(dir);
+
+	// pruning waits for compression, so no orphan archive is left behind
+	REQUIRE(os::create_directory(dir));
+	{
+		auto rotLogger = std::make_shared<log::Logger>("rotate_gz_prune", log::level_mask_from_string("info"));
+		auto sink = log::new_rotate_file_sink(fn, 100, true, 0, 0, log::RotateInterval::none, 2, true);
+		sink->set_format("%msg");
+		rotLogger->attach_sink(sink);
+		for (int i = 0; i < 30; ++i)
+		{
+			rotLogger->info("rotate line {}", i);
+			if (i % 3 == 2) time::sleep(2);
+		}
+	}
+	CHECK(os::list_directory(dir).size() == 3);
+	os::remove_dir(dir);
+}
+
+TEST_CASE("async logger", "logger")
+{
+	const char* fn = "test_async.log";
+	REQUIRE(os::remove_all(fn));
+	{
+		auto logger = log::get_logger("async");
+		logger->detach_all_sinks();
+		auto sink = log::new_async_sink(log::new_simple_file_sink(fn, true));
+		logger->attach_sink(sink);
+		logger->set_level_mask(log::level_mask_from_string("info"));
+
+		std::vector<std::thread> vt;
+		for (int i = 0; i < 4; ++i)
+		{
+			vt.push_back(std::thread([]()
+			{
+				auto threadLogger = log::get_logger("async");
+				for (int j = 0; j < 1000; ++j) threadLogger->info("Async sequence {}", j);
+			}));
+		}
+		for (auto &t : vt) t.join();
+		sink->flush();
+		log::drop_logger("async");
+	}
+
+	fs::FileReader fr(fn);
+	CHECK(fr.count_lines() == 4000);
+	fr.close();
+
+	SECTION("overflow policy")
+	{
+		std::stringstream oss;
+		auto overflowLogger = std::make_shared<log::Logger>("overflow");
+		auto sink = log::new_async_sink(log::new_ostream_sink(oss, "overflow_stream"), 2, log::OverflowPolicy::drop_newest);
+		overflowLogger->attach_sink(sink);
+		for (int i = 0; i < 1000; ++i) overflowLogger->info("Overflow test {}", i);
+		sink->flush();
+		std::size_t lines = 0;
+		std::string line;
+		while (std::getline(oss, line))
+		{
+			if (line.find("Overflow test") != std::string::npos) ++lines;
+		}
+		auto asyncSink = std::dynamic_pointer_cast<log::detail::AsyncSink>(sink);
+		REQUIRE(asyncSink);
+		CHECK(lines + asyncSink->dropped_count() == 1000);
+		// dropped messages are not counted as accepted
+		CHECK(sink->stats().accepted_ + sink->stats().dropped_ == 1000);
+		CHECK(log::overflow_policy_from_str("Drop_Oldest") == log::OverflowPolicy::drop_oldest);
+	}
+
+	std::stringstream ss;
+	ss << "[sinks]\nfile.type = simplefile\nfile.filename = test_async_cfg.log\n"
+		<< "async.type = async\nasync.backend = file\n"
+		<< "[loggers]\nasynccfg.sink_list = async\n";
+	log::config_from_stringstream(ss);
+	auto cfgLogger = log::get_logger("asynccfg");
+	CHECK(cfgLogger->get_sink(os::absolute_path("test_async_cfg.log")) == nullptr);
+	CHECK(cfgLogger->get_sink(std::string(log::consts::kAsyncSinkNamePrefix) + os::absolute_path("test_async_cfg.log")) != nullptr);
+}
+
+TEST_CASE("async sink shared backend", "logger")
+{
+	// level mask and format of the wrapper leave the backend used by other loggers alone
+	std::stringstream oss;
+	auto backend = log::new_ostream_sink(oss, "shared_stream");
+	backend->set_format("%msg");
+	auto direct = std::make_shared<log::Logger>("direct");
+	direct->attach_sink(backend);
+	auto wrapped = std::make_shared<log::Logger>("wrapped");
+	auto sink = log::new_async_sink(backend);
+	sink->set_format("async %msg");
+	sink->set_level_mask(log::level_mask_from_string("warn"));
+	wrapped->attach_sink(sink);
+	wrapped->info("skipped");
+	wrapped->warn("queued");
+	sink->flush();
+	direct->info("direct");
+	CHECK(oss.str() == "async queued" + os::endl() + "direct" + os::endl());
+	CHECK(sink->stats().filtered_ == 1);
+
+	// overflow summary uses the wrapper format as well
+	oss.str("");
+	auto overflow = log::new_async_sink(backend, 2, log::OverflowPolicy::drop_newest);
+	overflow->set_format("async %msg");
+	wrapped->detach_all_sinks();
+	wrapped->attach_sink(overflow);
+	for (int i = 0; i < 1000; ++i) wrapped->info("flood {}", i);
+	wrapped->detach_all_sinks();
+	overflow.reset();	// summary is reported when the worker stops
+	CHECK(oss.str().find("async Async sink dropped") != std::string::npos);
+}
+
 TEST_CASE("Image", "Image")
 {
 	Image image;
@@ -795,6 +1402,265 @@ TEST_CASE("Image", "Image")
 }
 
 
+TEST_CASE("Image roi view", "Image")
+{
+	Image src(20, 30, 3);
+	for (int r = 0; r < 20; ++r)
+	{
+		for (int c = 0; c < 30; ++c)
+		{
+			for (int k = 0; k < 3; ++k) src(r, c, k) = static_cast<unsigned char>((r * 30 + c + k) % 251);
+		}
+	}
+
+	Image view = src.roi(Rect(5, 4, 10, 8));
+	REQUIRE(view.rows() == 8);
+	REQUIRE(view.cols() == 10);
+	CHECK(view.step() == 90);
+	CHECK_FALSE(view.is_continuous());
+	CHECK(view.ptr(0, 0, 0) == src.ptr(4, 5, 0));
+	CHECK(view.at(7, 9, 2) == src.at(11, 14, 2));
+
+	// writing through ptr shares memory with the source
+	*view.ptr(1, 1, 1) = 7;
+	CHECK(src.at(5, 6, 1) == 7);
+
+	// nested views and export
+	Image tile = view.roi(2, 3, 4, 5);
+	CHECK(tile.at(0, 0, 0) == src.at(6, 8, 0));
+	std::vector<unsigned char> raw = tile.export_raw();
+	REQUIRE(raw.size() == 12u);
+	CHECK(raw[11] == src.at(7, 9, 2));
+
+	// clone materializes, () operator detaches the shared view
+	Image dense = view.clone();
+	CHECK(dense.is_continuous());
+	CHECK(dense.ptr(0) != view.ptr(0));
+	view(0, 0, 0) = 200;
+	CHECK(view.is_continuous());
+	CHECK(src.at(4, 5, 0) == (4 * 30 + 5) % 251);
+
+	// crop no longer copies
+	Image cropped = src;
+	cropped.crop(2, 3, 12, 13);
+	CHECK(cropped.ptr(0, 0, 0) == src.ptr(2, 3, 0));
+
+	// codecs and resize accept views
+	cropped.save("roi_test.bmp");
+	Image loaded("roi_test.bmp");
+	REQUIRE(loaded.rows() == 10);
+	CHECK(loaded.at(9, 9, 1) == cropped.at(9, 9, 1));
+	os::remove_all("roi_test.bmp");
+	cropped.resize(20, 20);
+	CHECK(cropped.is_continuous());
+	CHECK(cropped.rows() == 20);
+	ImageHdr hdr(Image(src.roi(0, 0, 2, 2)));
+	CHECK(hdr.at(1, 1, 0) == Approx(src.at(1, 1, 0) / 255.0));
+
+	// out of range or empty regions are rejected
+	CHECK_THROWS_AS(src.roi(0, 0, src.rows() + 1, 2), RuntimeException);
+	CHECK_THROWS_AS(src.roi(-1, 0, 2, 2), RuntimeException);
+	CHECK_THROWS_AS(src.roi(1, 1, 1, 4), RuntimeException);
+	CHECK_THROWS_AS(view.crop(0, 0, 20, 20), RuntimeException);
+}
+
+
+TEST_CASE("Image unchecked access", "Image")
+{
+	Image src(6, 8, 3);
+	src.ensure_unique();
+	for (int r = 0; r < src.rows(); ++r)
+	{
+		unsigned char* p = src.row_ptr(r);
+		for (int i = 0; i < src.cols() * src.channels(); ++i) p[i] = static_cast<unsigned char>(r * 24 + i);
+	}
+	CHECK(src.pixel(2, 3, 1) == 2 * 24 + 3 * 3 + 1);
+	CHECK(src(5, 7, 2) == src.at(5, 7, 2));
+
+	// const access never detaches shared storage
+	const Image shared = src;
+	CHECK(shared(1, 1, 1) == src.at(1, 1, 1));
+	CHECK(shared.row_ptr(0) == src.ptr(0));
+
+	// detach once, then write through unchecked accessors
+	Image copy = src;
+	copy.ensure_unique();
+	CHECK(copy.ptr(0) != src.ptr(0));
+	copy.pixel(0, 0, 0) = 255;
+	CHECK(src.at(0, 0, 0) == 0);
+
+	// row iterators span cols * channels of a strided view without copying it
+	Image view = src.roi(2, 1, 4, 4);
+	int count = 0;
+	for (Image::row_iterator it = view.row_begin(1); it != view.row_end(1); ++it) ++count;
+	CHECK(count == 9);
+	CHECK(*view.row_begin(1) == src.at(3, 1, 0));
+	CHECK(view.row_ptr(1) == src.ptr(3, 1, 0));
+
+	// mutable row pointers write through shared storage like pixel()
+	Image alias = src;
+	alias.row_ptr(0)[0] = 7;
+	CHECK(src.at(0, 0, 0) == 7);
+}
+
+
+namespace
+{
+	class CountingImageAllocator : public ImageAllocator
+	{
+	public:
+		CountingImageAllocator() : live(0), total(0) {}
+		void* allocate(std::size_t size, std::size_t alignment) override
+		{
+			++live;
+			++total;
+			return ImageAllocator::default_allocator()->allocate(size, alignment);
+		}
+		void deallocate(void* p, std::size_t size, std::size_t alignment) override
+		{
+			--live;
+			ImageAllocator::default_allocator()->deallocate(p, size, alignment);
+		}
+		int live;
+		int total;
+	};
+}
+
+TEST_CASE("Image aligned storage", "Image")
+{
+	Image packed(7, 5, 3);
+	CHECK(reinterpret_cast<std::size_t>(packed.ptr(0)) % consts::kImageAlignment == 0);
+	CHECK(packed.is_continuous());
+	CHECK(packed.at(6, 4, 2) == 0);
+
+	ImageHdr padded;
+	padded.create(4, 5, 3, 32);
+	CHECK(padded.step() == 16);
+	CHECK_FALSE(padded.is_continuous());
+	for (int r = 0; r < padded.rows(); ++r)
+	{
+		CHECK(reinterpret_cast<std::size_t>(padded.row_ptr(r)) % 32 == 0);
+	}
+	padded(3, 4, 2) = 0.5f;
+	ImageHdr dense = padded.clone();
+	CHECK(dense.is_continuous());
+	CHECK(dense.at(3, 4, 2) == Approx(0.5f));
+
+	auto alloc = std::make_shared<CountingImageAllocator>();
+	{
+		Image img;
+		img.set_allocator(alloc);
+		img.create(10, 10, 3);
+		CHECK(alloc->live == 1);
+		Image copy = img;
+		copy(0, 0, 0) = 1;	// copy-on-write goes through the same allocator
+		CHECK(alloc->live == 2);
+		copy.resize(20, 20);
+		CHECK(copy.allocator() == alloc);
+		CHECK(alloc->live == 2);
+	}
+	CHECK(alloc->live == 0);
+	CHECK(alloc->total == 3);
+}
+
+
+TEST_CASE("Image buffer pool", "Image")
+{
+	auto pool = std::make_shared<ImageBufferPool>(1 << 20);
+	{
+		Image a;
+		a.set_allocator(pool);
+		a.create(32, 32, 3);
+	}
+	ImageBufferPoolStats st = pool->stats();
+	CHECK(st.misses == 1);
+	CHECK(st.recycled == 1);
+	CHECK(st.cachedBlocks == 1);
+
+	Image b;
+	b.set_allocator(pool);
+	b.create(32, 32, 3);
+	CHECK(pool->stats().hits == 1);
+	CHECK(pool->stats().cachedBlocks == 0);
+	CHECK(b.at(31, 31, 2) == 0);
+
+	// blocks over the cap go back upstream
+	{
+		Image big;
+		big.set_allocator(pool);
+		big.create(1024, 1024, 3);
+	}
+	CHECK(pool->stats().evicted == 1);
+
+	// default allocator feeds images created without one, e.g. to_normal()
+	ImageAllocator::set_default_allocator(pool);
+	pool->reset_stats();
+	{
+		ImageHdr hdr(8, 8, 1);
+		{
+			Image normal = hdr.to_normal();
+		}
+		Image again = hdr.to_normal();
+	}
+	ImageAllocator::set_default_allocator(nullptr);
+	CHECK(pool->stats().misses == 2);
+	CHECK(pool->stats().hits == 1);
+	CHECK(ImageAllocator::default_allocator() != pool);
+	pool->trim();
+	CHECK(pool->stats().cachedBytes == 0);
+	CHECK_FALSE(pool->stats().to_string().empty());
+}
+
+
+TEST_CASE("Image parallel resize", "Image")
+{
+	Image src(300, 400, 3);
+	for (int r = 0; r < src.rows(); ++r)
+	{
+		unsigned char* p = src.row_ptr(r);
+		for (int i = 0; i < src.cols() * src.channels(); ++i) p[i] = static_cast<unsigned char>((r * 7 + i * 3) % 256);
+	}
+
+	// banded result matches a single pass
+	Image single = src;
+	single.resize(250, 170, ResizeFilter::automatic, ResizeEdge::clamp, 1);
+	Image multi = src;
+	multi.resize(250, 170, ResizeFilter::automatic, ResizeEdge::clamp, 4);
+	REQUIRE(multi.rows() == 170);
+	REQUIRE(multi.cols() == 250);
+	CHECK(multi.export_raw() == single.export_raw());
+
+	Image up = src;
+	up.resize(500, 640, ResizeFilter::triangle, ResizeEdge::reflect, 4);
+	Image upRef = src;
+	upRef.resize(500, 640, ResizeFilter::triangle, ResizeEdge::reflect, 1);
+	CHECK(up.export_raw() == upRef.export_raw());
+
+	ImageHdr hdr(src, 1.0f);
+	ImageHdr hdrRef = hdr;
+	hdr.resize(100, 150, ResizeFilter::box, ResizeEdge::clamp, 4);
+	hdrRef.resize(100, 150, ResizeFilter::box, ResizeEdge::clamp, 1);
+	CHECK(hdr.export_raw() == hdrRef.export_raw());
+
+	// workers restart after explicit stop
+	stop_resize_workers();
+	Image restarted = src;
+	restarted.resize(250, 170, ResizeFilter::automatic, ResizeEdge::clamp, 4);
+	CHECK(restarted.export_raw() == single.export_raw());
+	stop_resize_workers();
+
+	// Size and ratio keep width and height apart
+	Image sz = src;
+	sz.resize(Size(200, 100));
+	CHECK(sz.cols() == 200);
+	CHECK(sz.rows() == 100);
+	Image half = src;
+	half.resize(0.5);
+	CHECK(half.cols() == 200);
+	CHECK(half.rows() == 150);
+}
+
+
 int main(int argc, char** argv)
 {
 #ifdef _MSC_VER